@@ -0,0 +1,228 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "blt_tuner.h"
+
+/* The weight of the older samples decays by this factor with each new one */
+#define MODEL_DECAY          (255.0 / 256.0)
+/* The (weighted) number of samples needed before trusting the model */
+#define MODEL_MIN_SAMPLES    16.0
+/* The learned thresholds are clamped to this range (in bytes) */
+#define THRESHOLD_MIN        256
+#define THRESHOLD_MAX        (1024 * 1024)
+/* One of this many operations close to the threshold goes the other way */
+#define EXPLORE_PERIOD       32
+
+/* Decaying least squares fit of time = a + b * bytes */
+typedef struct {
+    double s0, sx, sy, sxx, sxy;
+    double a, b;
+    int    fitted;
+} cost_model_t;
+
+typedef struct {
+    cost_model_t hw;
+    cost_model_t cpu;
+    int          initial_threshold; /* in bytes */
+    unsigned     counter;
+} tuner_slot_t;
+
+typedef struct {
+    char         name[16];
+    int          bytes_per_pixel;
+} tuner_kind_t;
+
+struct blt_tuner_t {
+    pthread_mutex_t lock;
+    int             nkinds;
+    tuner_kind_t   *kinds;
+    tuner_slot_t   *slots;
+};
+
+static void model_add(cost_model_t *m, double x, double y)
+{
+    double den;
+
+    m->s0  = m->s0  * MODEL_DECAY + 1;
+    m->sx  = m->sx  * MODEL_DECAY + x;
+    m->sy  = m->sy  * MODEL_DECAY + y;
+    m->sxx = m->sxx * MODEL_DECAY + x * x;
+    m->sxy = m->sxy * MODEL_DECAY + x * y;
+
+    if (m->s0 < MODEL_MIN_SAMPLES)
+        return;
+
+    den = m->s0 * m->sxx - m->sx * m->sx;
+    if (den > m->s0 * m->sxx * 1e-6) {
+        m->b = (m->s0 * m->sxy - m->sx * m->sy) / den;
+        m->a = (m->sy - m->b * m->sx) / m->s0;
+    }
+    else {
+        /* all the samples have about the same size */
+        m->b = m->sy / m->sx;
+        m->a = 0;
+    }
+    /* the noise may result in nonsense */
+    if (m->b < 0) {
+        m->b = 0;
+        m->a = m->sy / m->s0;
+    }
+    if (m->a < 0) {
+        m->a = 0;
+        m->b = m->sy / m->sx;
+    }
+    m->fitted = 1;
+}
+
+/* Must be called with the lock held */
+static int get_threshold(tuner_slot_t *slot, int hw_requests)
+{
+    double threshold;
+
+    if (!slot->hw.fitted || !slot->cpu.fitted)
+        return slot->initial_threshold;
+
+    /* hw.a * n + hw.b * bytes < cpu.a + cpu.b * bytes */
+    if (slot->cpu.b <= slot->hw.b)
+        return THRESHOLD_MAX;
+    threshold = (slot->hw.a * hw_requests - slot->cpu.a) /
+                (slot->cpu.b - slot->hw.b);
+    if (threshold < THRESHOLD_MIN)
+        return THRESHOLD_MIN;
+    if (threshold > THRESHOLD_MAX)
+        return THRESHOLD_MAX;
+    return (int)threshold;
+}
+
+blt_tuner_t *blt_tuner_init(int nkinds)
+{
+    blt_tuner_t *tuner = calloc(1, sizeof(blt_tuner_t));
+    if (!tuner)
+        return NULL;
+
+    tuner->nkinds = nkinds;
+    tuner->kinds = calloc(nkinds, sizeof(tuner_kind_t));
+    tuner->slots = calloc(nkinds * BLT_TUNER_BUCKETS, sizeof(tuner_slot_t));
+    if (!tuner->kinds || !tuner->slots) {
+        free(tuner->kinds);
+        free(tuner->slots);
+        free(tuner);
+        return NULL;
+    }
+    pthread_mutex_init(&tuner->lock, NULL);
+    return tuner;
+}
+
+void blt_tuner_close(blt_tuner_t *tuner)
+{
+    pthread_mutex_destroy(&tuner->lock);
+    free(tuner->kinds);
+    free(tuner->slots);
+    free(tuner);
+}
+
+void blt_tuner_set_kind(blt_tuner_t *tuner, int kind, const char *name,
+                        int bytes_per_pixel, int initial_threshold)
+{
+    int i;
+    strncpy(tuner->kinds[kind].name, name, sizeof(tuner->kinds[kind].name) - 1);
+    tuner->kinds[kind].bytes_per_pixel = bytes_per_pixel;
+    for (i = 0; i < BLT_TUNER_BUCKETS; i++)
+        tuner->slots[kind * BLT_TUNER_BUCKETS + i].initial_threshold =
+            initial_threshold * bytes_per_pixel;
+}
+
+int blt_tuner_slot(int kind, int bytes_per_row)
+{
+    int bucket = bytes_per_row < 256 ? 0 : bytes_per_row < 2048 ? 1 : 2;
+    return kind * BLT_TUNER_BUCKETS + bucket;
+}
+
+int blt_tuner_use_hw(blt_tuner_t *tuner, int slot, int bytes,
+                     int hw_requests)
+{
+    tuner_slot_t *s = &tuner->slots[slot];
+    int threshold, use_hw;
+
+    pthread_mutex_lock(&tuner->lock);
+    threshold = get_threshold(s, hw_requests);
+    use_hw = bytes >= threshold;
+    if (bytes >= threshold / 4 && bytes / 4 < threshold &&
+        ++s->counter % EXPLORE_PERIOD == 0)
+        use_hw = !use_hw;
+    pthread_mutex_unlock(&tuner->lock);
+
+    return use_hw;
+}
+
+void blt_tuner_hw_sample(blt_tuner_t *tuner, int slot, int bytes,
+                         int64_t time_ns)
+{
+    pthread_mutex_lock(&tuner->lock);
+    model_add(&tuner->slots[slot].hw, bytes, time_ns);
+    pthread_mutex_unlock(&tuner->lock);
+}
+
+void blt_tuner_cpu_sample(blt_tuner_t *tuner, int slot, int bytes,
+                          int64_t time_ns)
+{
+    pthread_mutex_lock(&tuner->lock);
+    model_add(&tuner->slots[slot].cpu, bytes, time_ns);
+    pthread_mutex_unlock(&tuner->lock);
+}
+
+int64_t blt_tuner_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void blt_tuner_report(blt_tuner_t *tuner, char *buf, size_t size)
+{
+    size_t len = 0;
+    int kind, i;
+
+    buf[0] = 0;
+    pthread_mutex_lock(&tuner->lock);
+    for (kind = 0; kind < tuner->nkinds && len < size; kind++) {
+        tuner_kind_t *k = &tuner->kinds[kind];
+        len += snprintf(buf + len, size - len, "%s%s:", kind ? ", " : "",
+                        k->name);
+        for (i = 0; i < BLT_TUNER_BUCKETS && len < size; i++) {
+            tuner_slot_t *s = &tuner->slots[kind * BLT_TUNER_BUCKETS + i];
+            int fitted = s->hw.fitted && s->cpu.fitted;
+            len += snprintf(buf + len, size - len, " %d%s",
+                            get_threshold(s, 1) / k->bytes_per_pixel,
+                            fitted ? "" : "*");
+        }
+    }
+    pthread_mutex_unlock(&tuner->lock);
+}
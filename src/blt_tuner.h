@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BLT_TUNER_H
+#define BLT_TUNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Learns the size of the blits, starting from which the 2D hardware is
+ * faster than the CPU. The cost of each operation is modelled as a fixed
+ * overhead plus a per byte cost, separately for the hardware and the CPU,
+ * and fitted to the measured times of the recent operations. There is a
+ * model for each kind of operation (such as a particular combination of
+ * formats) and each of the width buckets (the CPU copies narrow rows at
+ * a lower speed). Occasionally the operations close to the threshold are
+ * deliberately sent the other way to keep both models up to date.
+ */
+typedef struct blt_tuner_t blt_tuner_t;
+
+/* Less than 256 bytes per row, less than 2048 bytes per row, the rest */
+#define BLT_TUNER_BUCKETS 3
+
+blt_tuner_t *blt_tuner_init(int nkinds);
+void blt_tuner_close(blt_tuner_t *tuner);
+
+/*
+ * Name the kind of operations for the report, set the number of bytes per
+ * destination pixel and the initial threshold in pixels (used until there
+ * are enough measurements).
+ */
+void blt_tuner_set_kind(blt_tuner_t *tuner, int kind, const char *name,
+                        int bytes_per_pixel, int initial_threshold);
+
+/*
+ * Returns the model index for the operation with 'bytes_per_row' (the
+ * buckets are the same for all the tuners)
+ */
+int blt_tuner_slot(int kind, int bytes_per_row);
+
+/*
+ * Decide whether the operation with 'bytes' of data, which needs
+ * 'hw_requests' hardware requests, should be done by the hardware.
+ */
+int blt_tuner_use_hw(blt_tuner_t *tuner, int slot, int bytes,
+                     int hw_requests);
+
+/*
+ * Record the time of a hardware request or a CPU operation. These may be
+ * called from any thread.
+ */
+void blt_tuner_hw_sample(blt_tuner_t *tuner, int slot, int bytes,
+                         int64_t time_ns);
+void blt_tuner_cpu_sample(blt_tuner_t *tuner, int slot, int bytes,
+                          int64_t time_ns);
+
+/* The monotonic clock for the measurements */
+int64_t blt_tuner_time_ns(void);
+
+/*
+ * Write the current thresholds (in pixels, for the operations done with a
+ * single hardware request) as a text line. The default thresholds, which
+ * are still not replaced by the learned ones, are marked with '*'.
+ */
+void blt_tuner_report(blt_tuner_t *tuner, char *buf, size_t size);
+
+#endif
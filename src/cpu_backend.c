@@ -21,13 +21,15 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "cpuinfo.h"
 #include "cpu_backend.h"
-
-#ifdef __arm__
+#include "x86_simd.h"
 
 #ifdef __GNUC__
 #define always_inline inline __attribute__((always_inline))
@@ -35,11 +37,22 @@
 #define always_inline inline
 #endif
 
+#ifdef __arm__
+
 void memcpy_armv5te(void *dst, const void *src, int size);
 void writeback_scratch_to_mem_neon(int size, void *dst, const void *src);
 void aligned_fetch_fbmem_to_scratch_neon(int size, void *dst, const void *src);
 void aligned_fetch_fbmem_to_scratch_vfp(int size, void *dst, const void *src);
 void aligned_fetch_fbmem_to_scratch_arm(int size, void *dst, const void *src);
+void aligned_fill_fbmem_neon(int size, void *dst, uint32_t pattern);
+void aligned_fill_fbmem_vfp(int size, void *dst, uint32_t pattern);
+void aligned_fill_fbmem_arm(int size, void *dst, uint32_t pattern);
+void transpose_8x8_32bpp_neon(void *dst, int dst_stride,
+                              const void *src, int src_stride);
+void transpose_8x8_16bpp_neon(void *dst, int dst_stride,
+                              const void *src, int src_stride);
+void convert_8888_to_0565_neon(uint16_t *dst, const uint32_t *src, int width,
+                               const uint8_t *dither);
 
 static always_inline void
 writeback_scratch_to_mem_arm(int size, void *dst, const void *src)
@@ -47,6 +60,57 @@ writeback_scratch_to_mem_arm(int size, void *dst, const void *src)
     memcpy_armv5te(dst, src, size);
 }
 
+#endif
+
+#ifdef __aarch64__
+
+void writeback_scratch_to_mem_a64(int size, void *dst, const void *src);
+void aligned_fetch_fbmem_to_scratch_a64_neon(int size, void *dst, const void *src);
+void aligned_fetch_fbmem_to_scratch_a64_ldp(int size, void *dst, const void *src);
+void aligned_fill_fbmem_a64(int size, void *dst, uint32_t pattern);
+void convert_8888_to_0565_a64_neon(uint16_t *dst, const uint32_t *src,
+                                   int width, const uint8_t *dither);
+
+#endif
+
+/*
+ * Portable C implementation of the fetch and writeback primitives. Both
+ * pointers in aligned_fetch_fbmem_to_scratch_c must be 32 bytes aligned
+ * and the size is rounded up to a multiple of 32 bytes (same as for the
+ * assembly variants). The compiler is expected to turn fixed size memcpy
+ * into a few wide load/store instructions.
+ */
+static void
+aligned_fetch_fbmem_to_scratch_c(int size, void *dst, const void *src)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    while (size > 0) {
+        memcpy(d, s, 32);
+        d += 32;
+        s += 32;
+        size -= 32;
+    }
+}
+
+static void
+writeback_scratch_to_mem_c(int size, void *dst, const void *src)
+{
+    memcpy(dst, src, size);
+}
+
+static void
+aligned_fill_fbmem_c(int size, void *dst, uint32_t pattern)
+{
+    uint32_t *d = (uint32_t *)dst;
+    while (size > 0) {
+        d[0] = pattern; d[1] = pattern; d[2] = pattern; d[3] = pattern;
+        d[4] = pattern; d[5] = pattern; d[6] = pattern; d[7] = pattern;
+        d += 8;
+        size -= 32;
+    }
+}
+
 #define SCRATCHSIZE 2048
 
 /*
@@ -56,7 +120,9 @@ writeback_scratch_to_mem_arm(int size, void *dst, const void *src)
  * Note: because this implementation fetches data as 32 byte aligned chunks
  * valgrind is going to scream about read accesses outside the source buffer.
  * (even if an aligned 32 byte chunk contains only a single byte belonging
- * to the source buffer, the whole chunk is going to be read).
+ * to the source buffer, the whole chunk is going to be read). But the chunks
+ * without any source bytes are never touched, so the reads can't cross a page
+ * boundary (or the end of the framebuffer mapping).
  */
 static always_inline void
 twopass_memmove(void *dst_, const void *src_, size_t size,
@@ -68,11 +134,10 @@ twopass_memmove(void *dst_, const void *src_, size_t size,
     uint8_t *dst = (uint8_t *)dst_;
     const uint8_t *src = (const uint8_t *)src_;
     uintptr_t alignshift = (uintptr_t)src & 31;
-    uintptr_t extrasize = (alignshift == 0) ? 0 : 32;
 
     if (src > dst) {
         while (size >= SCRATCHSIZE) {
-            aligned_fetch_fbmem_to_scratch(SCRATCHSIZE + extrasize,
+            aligned_fetch_fbmem_to_scratch(alignshift + SCRATCHSIZE,
                                            scratchbuf, src - alignshift);
             writeback_scratch_to_mem(SCRATCHSIZE, dst, scratchbuf + alignshift);
             size -= SCRATCHSIZE;
@@ -80,7 +145,7 @@ twopass_memmove(void *dst_, const void *src_, size_t size,
             src += SCRATCHSIZE;
         }
         if (size > 0) {
-            aligned_fetch_fbmem_to_scratch(size + extrasize,
+            aligned_fetch_fbmem_to_scratch(alignshift + size,
                                            scratchbuf, src - alignshift);
             writeback_scratch_to_mem(size, dst, scratchbuf + alignshift);
         }
@@ -91,7 +156,7 @@ twopass_memmove(void *dst_, const void *src_, size_t size,
         src += size - remainder;
         size -= remainder;
         if (remainder) {
-            aligned_fetch_fbmem_to_scratch(remainder + extrasize,
+            aligned_fetch_fbmem_to_scratch(alignshift + remainder,
                                            scratchbuf, src - alignshift);
             writeback_scratch_to_mem(remainder, dst, scratchbuf + alignshift);
         }
@@ -99,13 +164,15 @@ twopass_memmove(void *dst_, const void *src_, size_t size,
             dst -= SCRATCHSIZE;
             src -= SCRATCHSIZE;
             size -= SCRATCHSIZE;
-            aligned_fetch_fbmem_to_scratch(SCRATCHSIZE + extrasize,
+            aligned_fetch_fbmem_to_scratch(alignshift + SCRATCHSIZE,
                                            scratchbuf, src - alignshift);
             writeback_scratch_to_mem(SCRATCHSIZE, dst, scratchbuf + alignshift);
         }
     }
 }
 
+#ifdef __arm__
+
 static void
 twopass_memmove_neon(void *dst, const void *src, size_t size)
 {
@@ -130,6 +197,64 @@ twopass_memmove_arm(void *dst, const void *src, size_t size)
                     writeback_scratch_to_mem_arm);
 }
 
+#endif
+
+#ifdef __aarch64__
+
+static void
+twopass_memmove_a64_neon(void *dst, const void *src, size_t size)
+{
+    twopass_memmove(dst, src, size,
+                    aligned_fetch_fbmem_to_scratch_a64_neon,
+                    writeback_scratch_to_mem_a64);
+}
+
+static void
+twopass_memmove_a64_ldp(void *dst, const void *src, size_t size)
+{
+    twopass_memmove(dst, src, size,
+                    aligned_fetch_fbmem_to_scratch_a64_ldp,
+                    writeback_scratch_to_mem_a64);
+}
+
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+
+static void
+twopass_memmove_sse2(void *dst, const void *src, size_t size)
+{
+    twopass_memmove(dst, src, size,
+                    aligned_fetch_fbmem_to_scratch_sse2,
+                    writeback_scratch_to_mem_sse2);
+}
+
+static void
+twopass_memmove_sse41(void *dst, const void *src, size_t size)
+{
+    twopass_memmove(dst, src, size,
+                    aligned_fetch_fbmem_to_scratch_sse41,
+                    writeback_scratch_to_mem_sse2);
+}
+
+static void
+twopass_memmove_avx2(void *dst, const void *src, size_t size)
+{
+    twopass_memmove(dst, src, size,
+                    aligned_fetch_fbmem_to_scratch_avx2,
+                    writeback_scratch_to_mem_avx2);
+}
+
+#endif
+
+static void
+twopass_memmove_c(void *dst, const void *src, size_t size)
+{
+    twopass_memmove(dst, src, size,
+                    aligned_fetch_fbmem_to_scratch_c,
+                    writeback_scratch_to_mem_c);
+}
+
 static void
 twopass_blt_8bpp(int        width,
                  int        height,
@@ -165,6 +290,312 @@ twopass_blt_8bpp(int        width,
     }
 }
 
+/*
+ * Multi-threaded processing of large blits. The rows are split into bands,
+ * which are processed by the threads from the worker pool in parallel.
+ */
+
+/* Don't bother creating the bands smaller than this (in bytes) */
+#define PARALLEL_BLT_MIN_BAND_SIZE     (16 * 1024)
+/* The default for cpu_backend_t::parallel_blt_threshold */
+#define PARALLEL_BLT_DEFAULT_THRESHOLD (128 * 1024)
+
+typedef struct {
+    uint8_t   *dst_bytes;
+    uint8_t   *src_bytes;
+    uintptr_t  dst_stride;
+    uintptr_t  src_stride;
+    int        width;
+    int        rows_per_job;
+    int        height;
+    void     (*twopass_memmove)(void *, const void *, size_t);
+} blt_band_job_t;
+
+static void
+blt_band_job(void *arg, int job)
+{
+    blt_band_job_t *band = (blt_band_job_t *)arg;
+    int first_row = job * band->rows_per_job;
+    int rows = band->height - first_row;
+    if (rows > band->rows_per_job)
+        rows = band->rows_per_job;
+    twopass_blt_8bpp(band->width, rows,
+                     band->dst_bytes + first_row * band->dst_stride,
+                     band->dst_stride,
+                     band->src_bytes + first_row * band->src_stride,
+                     band->src_stride,
+                     band->twopass_memmove);
+}
+
+/*
+ * Process the rows [first_row, first_row + rows) using all the worker
+ * threads. The caller ensures that these rows are independent from
+ * each other (no destination row overlaps a source row of another one).
+ */
+static void
+twopass_blt_8bpp_parallel_rows(cpu_backend_t *ctx,
+                               blt_band_job_t *band,
+                               uint8_t   *dst_bytes,
+                               uint8_t   *src_bytes,
+                               int        first_row,
+                               int        rows)
+{
+    int nthreads = worker_pool_nthreads(ctx->worker_pool);
+    int min_rows = PARALLEL_BLT_MIN_BAND_SIZE / band->width + 1;
+    int rows_per_job = (rows + nthreads - 1) / nthreads;
+    if (rows_per_job < min_rows)
+        rows_per_job = min_rows;
+
+    band->dst_bytes    = dst_bytes + first_row * band->dst_stride;
+    band->src_bytes    = src_bytes + first_row * band->src_stride;
+    band->height       = rows;
+    band->rows_per_job = rows_per_job;
+    worker_pool_run(ctx->worker_pool, (rows + rows_per_job - 1) / rows_per_job,
+                    blt_band_job, band);
+}
+
+/*
+ * The same as twopass_blt_8bpp, but splitting the work between multiple
+ * threads when it is large enough. The bands still follow the overlap
+ * direction rules: if the source and destination areas overlap and are
+ * vertically shifted by 'dy' rows, then only up to 'dy' consecutive rows
+ * may be copied in parallel (and such groups of rows are processed one
+ * after another starting from the side, which is not overwritten).
+ */
+static void
+twopass_blt_8bpp_mt(cpu_backend_t *ctx,
+                    int        width,
+                    int        height,
+                    uint8_t   *dst_bytes,
+                    uintptr_t  dst_stride,
+                    uint8_t   *src_bytes,
+                    uintptr_t  src_stride,
+                    int        dy,
+                    void (*twopass_memmove)(void *, const void *, size_t))
+{
+    blt_band_job_t band;
+    int group_rows, row;
+
+    if (!ctx->worker_pool || height < 2 ||
+        (uint64_t)width * height < (uint64_t)ctx->parallel_blt_threshold)
+    {
+        twopass_blt_8bpp(width, height, dst_bytes, dst_stride,
+                         src_bytes, src_stride, twopass_memmove);
+        return;
+    }
+
+    group_rows = height;
+    if (src_bytes < dst_bytes + dst_stride * (height - 1) + width &&
+        src_bytes + src_stride * (height - 1) + width > dst_bytes)
+    {
+        /* Overlapping areas in the same buffer must have the same stride */
+        if (src_stride != dst_stride)
+            group_rows = 0;
+        else if (dy != 0)
+            group_rows = dy < 0 ? -dy : dy;
+    }
+
+    if ((uint64_t)width * group_rows < 2 * PARALLEL_BLT_MIN_BAND_SIZE) {
+        twopass_blt_8bpp(width, height, dst_bytes, dst_stride,
+                         src_bytes, src_stride, twopass_memmove);
+        return;
+    }
+
+    band.dst_stride      = dst_stride;
+    band.src_stride      = src_stride;
+    band.width           = width;
+    band.twopass_memmove = twopass_memmove;
+
+    if (group_rows < height && dst_bytes > src_bytes) {
+        /* Moving down: start from the bottom */
+        for (row = height; row > 0; row -= group_rows) {
+            int first_row = row > group_rows ? row - group_rows : 0;
+            twopass_blt_8bpp_parallel_rows(ctx, &band, dst_bytes, src_bytes,
+                                           first_row, row - first_row);
+        }
+    }
+    else {
+        for (row = 0; row < height; row += group_rows) {
+            int rows = height - row < group_rows ? height - row : group_rows;
+            twopass_blt_8bpp_parallel_rows(ctx, &band, dst_bytes, src_bytes,
+                                           row, rows);
+        }
+    }
+}
+
+/*
+ * Format converting blits (r5g6b5 <-> a8r8g8b8) using the same two-pass
+ * approach. A chunk of each source row is fetched into a scratch buffer,
+ * converted into another scratch buffer and then written to the
+ * destination. The 32bpp to 16bpp conversion may use 4x4 ordered
+ * dithering, anchored to the destination coordinates.
+ */
+
+static const uint8_t dither_matrix_4x4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+/*
+ * The generic C variant of the ctx->convert_8888_to_0565 kernel. Unlike
+ * the SIMD ones, it also handles the widths which are not a multiple of 8.
+ */
+static void
+convert_8888_to_0565_c(uint16_t *dst, const uint32_t *src, int width,
+                       const uint8_t *dither)
+{
+    int i;
+    for (i = 0; i < width; i++) {
+        uint32_t p = src[i];
+        int r = ((p >> 16) & 0xFF) + dither[i & 7];
+        int g = ((p >> 8) & 0xFF) + dither[8 + (i & 7)];
+        int b = (p & 0xFF) + dither[i & 7];
+        if (r > 0xFF)
+            r = 0xFF;
+        if (g > 0xFF)
+            g = 0xFF;
+        if (b > 0xFF)
+            b = 0xFF;
+        dst[i] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+}
+
+/*
+ * Convert a row of pixels starting at the destination coordinates (x, y),
+ * with or without dithering depending on ctx->dither_32_to_16.
+ */
+static void
+convert_8888_to_0565_row(cpu_backend_t  *ctx,
+                         uint16_t       *dst,
+                         const uint32_t *src,
+                         int             width,
+                         int             x,
+                         int             y)
+{
+    uint8_t dither[16] = { 0 };
+    int simd_width = width & ~7;
+    int i;
+
+    if (ctx->dither_32_to_16) {
+        for (i = 0; i < 8; i++) {
+            int d = dither_matrix_4x4[y & 3][(x + i) & 3];
+            dither[i]     = d >> 1;
+            dither[8 + i] = d >> 2;
+        }
+    }
+    if (simd_width > 0)
+        ctx->convert_8888_to_0565(dst, src, simd_width, dither);
+    if (width > simd_width)
+        convert_8888_to_0565_c(dst + simd_width, src + simd_width,
+                               width - simd_width, dither);
+}
+
+static void
+convert_0565_to_8888(uint32_t *dst, const uint16_t *src, int width)
+{
+    while (--width >= 0) {
+        uint32_t p = *src++;
+        uint32_t r = (p >> 11) & 0x1F;
+        uint32_t g = (p >> 5) & 0x3F;
+        uint32_t b = p & 0x1F;
+        *dst++ = 0xFF000000 | (((r << 3) | (r >> 2)) << 16) |
+                 (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+    }
+}
+
+/* The number of pixels converted at once */
+#define CONVERT_CHUNK_PIXELS (SCRATCHSIZE / 4)
+
+static void
+twopass_convert_row(cpu_backend_t *ctx,
+                    uint8_t       *dst,
+                    const uint8_t *src,
+                    int            src_bpp,
+                    int            dst_bpp,
+                    int            width,
+                    int            dst_x,
+                    int            dst_y)
+{
+    uint8_t tmpbuf[SCRATCHSIZE + 32 + 31];
+    uint8_t outbuf[SCRATCHSIZE + 31];
+    uint8_t *scratchbuf = (uint8_t *)((uintptr_t)(&tmpbuf[0] + 31) & ~31);
+    uint8_t *convbuf = (uint8_t *)((uintptr_t)(&outbuf[0] + 31) & ~31);
+    int src_bytespp = src_bpp >> 3;
+    int dst_bytespp = dst_bpp >> 3;
+
+    while (width > 0) {
+        int n = width < CONVERT_CHUNK_PIXELS ? width : CONVERT_CHUNK_PIXELS;
+        uintptr_t alignshift = (uintptr_t)src & 31;
+
+        ctx->fetch(alignshift + n * src_bytespp, scratchbuf, src - alignshift);
+        if (src_bpp == 16) {
+            convert_0565_to_8888((uint32_t *)convbuf,
+                                 (uint16_t *)(scratchbuf + alignshift), n);
+        }
+        else {
+            convert_8888_to_0565_row(ctx, (uint16_t *)convbuf,
+                                     (uint32_t *)(scratchbuf + alignshift),
+                                     n, dst_x, dst_y);
+        }
+        ctx->writeback(n * dst_bytespp, dst, convbuf);
+
+        src += n * src_bytespp;
+        dst += n * dst_bytespp;
+        dst_x += n;
+        width -= n;
+    }
+}
+
+static int
+convert_blt(cpu_backend_t *ctx,
+            uint32_t *src_bits,
+            uint32_t *dst_bits,
+            int       src_stride,
+            int       dst_stride,
+            int       src_bpp,
+            int       dst_bpp,
+            int       src_x,
+            int       src_y,
+            int       dst_x,
+            int       dst_y,
+            int       width,
+            int       height)
+{
+    uint8_t *dst_bytes = (uint8_t *)dst_bits;
+    uint8_t *src_bytes = (uint8_t *)src_bits;
+    int uncached_source = (src_bytes >= ctx->uncached_area_begin) &&
+                          (src_bytes < ctx->uncached_area_end);
+    int uncached_destination = (dst_bytes >= ctx->uncached_area_begin) &&
+                               (dst_bytes < ctx->uncached_area_end);
+
+    /* Only useful if the framebuffer is involved */
+    if (!uncached_source && !uncached_destination)
+        return 0;
+
+    if (!((src_bpp == 32 && dst_bpp == 16) || (src_bpp == 16 && dst_bpp == 32)) ||
+        src_stride < 0 || dst_stride < 0)
+        return 0;
+
+    /* The source and destination are different pixmaps */
+    if (src_bits == dst_bits)
+        return 0;
+
+    if (width <= 0 || height <= 0)
+        return 1;
+
+    src_bytes += (uintptr_t) src_y * src_stride * 4 + (uintptr_t) src_x * (src_bpp >> 3);
+    dst_bytes += (uintptr_t) dst_y * dst_stride * 4 + (uintptr_t) dst_x * (dst_bpp >> 3);
+    while (--height >= 0) {
+        twopass_convert_row(ctx, dst_bytes, src_bytes, src_bpp, dst_bpp,
+                            width, dst_x, dst_y++);
+        src_bytes += (uintptr_t) src_stride * 4;
+        dst_bytes += (uintptr_t) dst_stride * 4;
+    }
+    return 1;
+}
+
 static always_inline int
 overlapped_blt(void     *self,
                uint32_t *src_bits,
@@ -187,24 +618,34 @@ overlapped_blt(void     *self,
     int bpp = src_bpp >> 3;
     int uncached_source = (src_bytes >= ctx->uncached_area_begin) &&
                           (src_bytes < ctx->uncached_area_end);
+
+    if (src_bpp != dst_bpp)
+        return convert_blt(ctx, src_bits, dst_bits, src_stride, dst_stride,
+                           src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                           width, height);
+
     if (!uncached_source)
         return 0;
 
-    if (src_bpp != dst_bpp || src_bpp & 7 || src_stride < 0 || dst_stride < 0)
+    if (src_bpp & 7 || src_stride < 0 || dst_stride < 0)
         return 0;
 
-    twopass_blt_8bpp((uintptr_t) width * bpp,
-                     height,
-                     dst_bytes + (uintptr_t) dst_y * dst_stride * 4 +
-                                 (uintptr_t) dst_x * bpp,
-                     (uintptr_t) dst_stride * 4,
-                     src_bytes + (uintptr_t) src_y * src_stride * 4 +
-                                 (uintptr_t) src_x * bpp,
-                     (uintptr_t) src_stride * 4,
-                     twopass_memmove);
+    twopass_blt_8bpp_mt(ctx,
+                        (uintptr_t) width * bpp,
+                        height,
+                        dst_bytes + (uintptr_t) dst_y * dst_stride * 4 +
+                                    (uintptr_t) dst_x * bpp,
+                        (uintptr_t) dst_stride * 4,
+                        src_bytes + (uintptr_t) src_y * src_stride * 4 +
+                                    (uintptr_t) src_x * bpp,
+                        (uintptr_t) src_stride * 4,
+                        dst_y - src_y,
+                        twopass_memmove);
     return 1;
 }
 
+#ifdef __arm__
+
 static int
 overlapped_blt_neon(void     *self,
                     uint32_t *src_bits,
@@ -270,9 +711,56 @@ overlapped_blt_arm(void     *self,
 
 #endif
 
-/* An empty, always failing implementation */
+#ifdef __aarch64__
+
+static int
+overlapped_blt_a64_neon(void     *self,
+                        uint32_t *src_bits,
+                        uint32_t *dst_bits,
+                        int       src_stride,
+                        int       dst_stride,
+                        int       src_bpp,
+                        int       dst_bpp,
+                        int       src_x,
+                        int       src_y,
+                        int       dst_x,
+                        int       dst_y,
+                        int       width,
+                        int       height)
+{
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          twopass_memmove_a64_neon);
+}
+
 static int
-overlapped_blt_noop(void     *self,
+overlapped_blt_a64_ldp(void     *self,
+                       uint32_t *src_bits,
+                       uint32_t *dst_bits,
+                       int       src_stride,
+                       int       dst_stride,
+                       int       src_bpp,
+                       int       dst_bpp,
+                       int       src_x,
+                       int       src_y,
+                       int       dst_x,
+                       int       dst_y,
+                       int       width,
+                       int       height)
+{
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          twopass_memmove_a64_ldp);
+}
+
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+
+static int
+overlapped_blt_sse2(void     *self,
                     uint32_t *src_bits,
                     uint32_t *dst_bits,
                     int       src_stride,
@@ -286,6 +774,947 @@ overlapped_blt_noop(void     *self,
                     int       width,
                     int       height)
 {
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          twopass_memmove_sse2);
+}
+
+static int
+overlapped_blt_sse41(void     *self,
+                     uint32_t *src_bits,
+                     uint32_t *dst_bits,
+                     int       src_stride,
+                     int       dst_stride,
+                     int       src_bpp,
+                     int       dst_bpp,
+                     int       src_x,
+                     int       src_y,
+                     int       dst_x,
+                     int       dst_y,
+                     int       width,
+                     int       height)
+{
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          twopass_memmove_sse41);
+}
+
+static int
+overlapped_blt_avx2(void     *self,
+                    uint32_t *src_bits,
+                    uint32_t *dst_bits,
+                    int       src_stride,
+                    int       dst_stride,
+                    int       src_bpp,
+                    int       dst_bpp,
+                    int       src_x,
+                    int       src_y,
+                    int       dst_x,
+                    int       dst_y,
+                    int       width,
+                    int       height)
+{
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          twopass_memmove_avx2);
+}
+
+#endif
+
+static int
+overlapped_blt_c(void     *self,
+                 uint32_t *src_bits,
+                 uint32_t *dst_bits,
+                 int       src_stride,
+                 int       dst_stride,
+                 int       src_bpp,
+                 int       dst_bpp,
+                 int       src_x,
+                 int       src_y,
+                 int       dst_x,
+                 int       dst_y,
+                 int       width,
+                 int       height)
+{
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          twopass_memmove_c);
+}
+
+/*
+ * Solid fill of a rectangle in the uncached area. The bulk of each row is
+ * written by the 'aligned_fill_fbmem' function as 32 bytes aligned chunks.
+ * The 32-bit pattern is stored in memory at 4 bytes aligned addresses, so
+ * the edges can be filled by just picking the right bytes from it.
+ */
+static always_inline int
+fill(void     *self,
+     uint32_t *bits,
+     int       stride,
+     int       bpp,
+     int       x,
+     int       y,
+     int       width,
+     int       height,
+     uint32_t  filler,
+     void (*aligned_fill_fbmem)(int, void *, uint32_t))
+{
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    uint8_t *row = (uint8_t *)bits;
+    uint8_t *pattern_bytes;
+    uint32_t pattern;
+    int row_bytes;
+
+    if (row < ctx->uncached_area_begin || row >= ctx->uncached_area_end)
+        return 0;
+
+    if (bpp == 8)
+        pattern = (filler & 0xFF) * 0x01010101;
+    else if (bpp == 16)
+        pattern = (filler & 0xFFFF) * 0x00010001;
+    else if (bpp == 32)
+        pattern = filler;
+    else
+        return 0;
+
+    if (stride < 0 || width <= 0 || height <= 0)
+        return width <= 0 || height <= 0;
+
+    pattern_bytes = (uint8_t *)&pattern;
+    row_bytes = width * (bpp >> 3);
+    row += (uintptr_t) y * stride * 4 + (uintptr_t) x * (bpp >> 3);
+
+    while (--height >= 0) {
+        uint8_t *d = row;
+        int size = row_bytes;
+        while (((uintptr_t)d & 3) && size > 0) {
+            *d = pattern_bytes[(uintptr_t)d & 3];
+            d++;
+            size--;
+        }
+        if (size >= 64) {
+            int aligned_size;
+            while ((uintptr_t)d & 31) {
+                *(uint32_t *)d = pattern;
+                d += 4;
+                size -= 4;
+            }
+            aligned_size = size & ~31;
+            aligned_fill_fbmem(aligned_size, d, pattern);
+            d += aligned_size;
+            size -= aligned_size;
+        }
+        while (size >= 4) {
+            *(uint32_t *)d = pattern;
+            d += 4;
+            size -= 4;
+        }
+        while (size > 0) {
+            *d = pattern_bytes[(uintptr_t)d & 3];
+            d++;
+            size--;
+        }
+        row += stride * 4;
+    }
+    return 1;
+}
+
+#ifdef __arm__
+
+static int
+fill_neon(void *self, uint32_t *bits, int stride, int bpp,
+          int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_neon);
+}
+
+static int
+fill_vfp(void *self, uint32_t *bits, int stride, int bpp,
+         int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_vfp);
+}
+
+static int
+fill_arm(void *self, uint32_t *bits, int stride, int bpp,
+         int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_arm);
+}
+
+#endif
+
+#ifdef __aarch64__
+
+static int
+fill_a64(void *self, uint32_t *bits, int stride, int bpp,
+         int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_a64);
+}
+
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+
+static int
+fill_sse2(void *self, uint32_t *bits, int stride, int bpp,
+          int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_sse2);
+}
+
+static int
+fill_avx2(void *self, uint32_t *bits, int stride, int bpp,
+          int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_avx2);
+}
+
+#endif
+
+static int
+fill_c(void *self, uint32_t *bits, int stride, int bpp,
+       int x, int y, int width, int height, uint32_t filler)
+{
+    return fill(self, bits, stride, bpp, x, y, width, height, filler,
+                aligned_fill_fbmem_c);
+}
+
+static always_inline int
+get_size_class(int row_bytes)
+{
+    if (row_bytes < 256)
+        return 0;
+    else if (row_bytes < 2048)
+        return 1;
+    else
+        return 2;
+}
+
+static int
+overlapped_blt_calibrated(void     *self,
+                          uint32_t *src_bits,
+                          uint32_t *dst_bits,
+                          int       src_stride,
+                          int       dst_stride,
+                          int       src_bpp,
+                          int       dst_bpp,
+                          int       src_x,
+                          int       src_y,
+                          int       dst_x,
+                          int       dst_y,
+                          int       width,
+                          int       height)
+{
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    int size_class = get_size_class(width * (src_bpp >> 3));
+    return overlapped_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                          src_bpp, dst_bpp, src_x, src_y, dst_x, dst_y,
+                          width, height,
+                          ctx->size_class_memmove[size_class]);
+}
+
+/*
+ * The blt2d_i::blt_boxes implementation. Does the checks only once and
+ * picks the kernel for each (merged) box according to its size class.
+ */
+static int
+blt_boxes(void              *self,
+          uint32_t          *src_bits,
+          uint32_t          *dst_bits,
+          int                src_stride,
+          int                dst_stride,
+          int                src_bpp,
+          int                dst_bpp,
+          const blt2d_box_t *boxes,
+          int                nboxes,
+          int                src_dx,
+          int                src_dy,
+          int                dst_dx,
+          int                dst_dy)
+{
+    uint8_t *dst_bytes = (uint8_t *)dst_bits;
+    uint8_t *src_bytes = (uint8_t *)src_bits;
+    cpu_backend_t *ctx = (cpu_backend_t *)self;
+    int bpp = src_bpp >> 3;
+    int i = 0;
+    int uncached_source = (src_bytes >= ctx->uncached_area_begin) &&
+                          (src_bytes < ctx->uncached_area_end);
+
+    if (src_bpp != dst_bpp) {
+        for (i = 0; i < nboxes; i++) {
+            const blt2d_box_t *b = &boxes[i];
+            if (!convert_blt(ctx, src_bits, dst_bits, src_stride, dst_stride,
+                             src_bpp, dst_bpp, b->x1 + src_dx, b->y1 + src_dy,
+                             b->x1 + dst_dx, b->y1 + dst_dy,
+                             b->x2 - b->x1, b->y2 - b->y1))
+                return i;
+        }
+        return nboxes;
+    }
+
+    if (!uncached_source)
+        return 0;
+
+    if (src_bpp & 7 || src_stride < 0 || dst_stride < 0)
+        return 0;
+
+    while (i < nboxes) {
+        blt2d_box_t b;
+        int width, height;
+        i += blt2d_merge_boxes(boxes + i, nboxes - i, &b);
+        width = b.x2 - b.x1;
+        height = b.y2 - b.y1;
+        if (width <= 0 || height <= 0)
+            continue;
+        twopass_blt_8bpp_mt(ctx,
+                            (uintptr_t) width * bpp,
+                            height,
+                            dst_bytes + (uintptr_t) (b.y1 + dst_dy) * dst_stride * 4 +
+                                        (uintptr_t) (b.x1 + dst_dx) * bpp,
+                            (uintptr_t) dst_stride * 4,
+                            src_bytes + (uintptr_t) (b.y1 + src_dy) * src_stride * 4 +
+                                        (uintptr_t) (b.x1 + src_dx) * bpp,
+                            (uintptr_t) src_stride * 4,
+                            dst_dy - src_dy,
+                            ctx->size_class_memmove[get_size_class(width * bpp)]);
+    }
+    return nboxes;
+}
+
+/*
+ * Screen rotation for the shadow framebuffer. The destination is split into
+ * 8x8 tiles aligned to the framebuffer coordinates, which are done by the
+ * transpose kernels (the rows of a tile are written one after another, and
+ * the tiles are processed from left to right). Only the partial tiles at the
+ * edges and 180 degrees rotation are done one pixel at a time.
+ *
+ * A destination pixel (x, y) is taken from 'src + x * step_x + y * step_y'.
+ */
+
+static void
+transpose_8x8_32bpp_c(void *dst, int dst_stride, const void *src, int src_stride)
+{
+    int i, j;
+    for (j = 0; j < 8; j++) {
+        uint32_t *d = (uint32_t *)((uint8_t *)dst + j * dst_stride);
+        for (i = 0; i < 8; i++)
+            d[i] = *(const uint32_t *)((const uint8_t *)src +
+                                       i * src_stride + j * 4);
+    }
+}
+
+static void
+transpose_8x8_16bpp_c(void *dst, int dst_stride, const void *src, int src_stride)
+{
+    int i, j;
+    for (j = 0; j < 8; j++) {
+        uint16_t *d = (uint16_t *)((uint8_t *)dst + j * dst_stride);
+        for (i = 0; i < 8; i++)
+            d[i] = *(const uint16_t *)((const uint8_t *)src +
+                                       i * src_stride + j * 2);
+    }
+}
+
+static void
+rotate_pixels(uint8_t       *dst,
+              intptr_t       dst_stride,
+              const uint8_t *src,
+              intptr_t       step_x,
+              intptr_t       step_y,
+              int            bytespp,
+              int            x,
+              int            y,
+              int            w,
+              int            h)
+{
+    int i, j;
+    for (j = y; j < y + h; j++) {
+        const uint8_t *s = src + x * step_x + j * step_y;
+        uint8_t *d = dst + j * dst_stride + x * bytespp;
+        if (bytespp == 4) {
+            for (i = 0; i < w; i++, s += step_x)
+                ((uint32_t *)d)[i] = *(const uint32_t *)s;
+        }
+        else if (bytespp == 2) {
+            for (i = 0; i < w; i++, s += step_x)
+                ((uint16_t *)d)[i] = *(const uint16_t *)s;
+        }
+        else {
+            for (i = 0; i < w; i++, s += step_x)
+                d[i] = *s;
+        }
+    }
+}
+
+int cpu_backend_rotated_blt(cpu_backend_t *ctx,
+                            uint32_t      *src_bits,
+                            uint32_t      *dst_bits,
+                            int            src_stride,
+                            int            dst_stride,
+                            int            bpp,
+                            int            rotation,
+                            int            src_width,
+                            int            src_height,
+                            int            x,
+                            int            y,
+                            int            w,
+                            int            h)
+{
+    void (*transpose)(void *, int, const void *, int);
+    uint8_t *dst = (uint8_t *)dst_bits;
+    uint8_t *src = (uint8_t *)src_bits;
+    intptr_t dstride = (intptr_t)dst_stride * 4;
+    intptr_t sstride = (intptr_t)src_stride * 4;
+    int bytespp = bpp >> 3;
+    intptr_t step_x, step_y;
+    int dx, dy, dw, dh, tx0, tx1, tx, ty;
+
+    if (bpp == 32)
+        transpose = ctx->transpose_8x8_32bpp;
+    else if (bpp == 16)
+        transpose = ctx->transpose_8x8_16bpp;
+    else if (bpp == 8)
+        transpose = NULL;
+    else
+        return 0;
+
+    /* Find the destination rectangle and the mapping to the source */
+    switch (rotation) {
+    case 90:
+        /* The source pixel (x, y) goes to (y, src_width - 1 - x) */
+        src += (src_width - 1) * bytespp;
+        step_x = sstride;
+        step_y = -bytespp;
+        dx = y;
+        dy = src_width - x - w;
+        dw = h;
+        dh = w;
+        break;
+    case 180:
+        src += (src_height - 1) * sstride + (src_width - 1) * bytespp;
+        step_x = -bytespp;
+        step_y = -sstride;
+        dx = src_width - x - w;
+        dy = src_height - y - h;
+        dw = w;
+        dh = h;
+        transpose = NULL;
+        break;
+    case 270:
+        /* The source pixel (x, y) goes to (src_height - 1 - y, x) */
+        src += (src_height - 1) * sstride;
+        step_x = -sstride;
+        step_y = bytespp;
+        dx = src_height - y - h;
+        dy = x;
+        dw = h;
+        dh = w;
+        break;
+    default:
+        return 0;
+    }
+
+    tx0 = (dx + 7) & ~7;
+    tx1 = (dx + dw) & ~7;
+    if (!transpose || tx0 >= tx1) {
+        rotate_pixels(dst, dstride, src, step_x, step_y, bytespp, dx, dy, dw, dh);
+        return 1;
+    }
+
+    for (ty = dy; ty + 8 <= dy + dh; ty += 8) {
+        rotate_pixels(dst, dstride, src, step_x, step_y, bytespp,
+                      dx, ty, tx0 - dx, 8);
+        for (tx = tx0; tx < tx1; tx += 8) {
+            /* Walk the destination rows backwards if needed */
+            if (step_y > 0)
+                transpose(dst + ty * dstride + tx * bytespp, dstride,
+                          src + tx * step_x + ty * step_y, step_x);
+            else
+                transpose(dst + (ty + 7) * dstride + tx * bytespp, -dstride,
+                          src + tx * step_x + (ty + 7) * step_y, step_x);
+        }
+        rotate_pixels(dst, dstride, src, step_x, step_y, bytespp,
+                      tx1, ty, dx + dw - tx1, 8);
+    }
+    rotate_pixels(dst, dstride, src, step_x, step_y, bytespp,
+                  dx, ty, dw, dy + dh - ty);
+    return 1;
+}
+
+/*
+ * Shadow framebuffer updates. The damaged boxes are coalesced into a few
+ * larger rectangles (copying a bit of undamaged area is cheaper than many
+ * tiny copies, but not if most of the copied data is undamaged). Large
+ * rectangles are split into row bands and copied by the worker threads.
+ * The source is in cached memory, so only the writeback kernel is needed.
+ * A 32bpp shadow framebuffer may also be converted to a 16bpp framebuffer
+ * on the way, in chunks of CONVERT_CHUNK_PIXELS.
+ */
+
+typedef struct {
+    cpu_backend_t *ctx;
+    uint8_t   *dst_bytes;
+    uint8_t   *src_bytes;
+    uintptr_t  dst_stride;
+    uintptr_t  src_stride;
+    int        src_bytespp;
+    int        dst_bytespp;
+    int        x;
+    int        y;
+    int        width;
+    int        rows_per_job;
+    int        height;
+} shadow_band_job_t;
+
+static void
+shadow_convert_row(cpu_backend_t *ctx, uint8_t *dst, const uint8_t *src,
+                   int width, int x, int y)
+{
+    uint8_t outbuf[CONVERT_CHUNK_PIXELS * 2 + 31];
+    uint16_t *convbuf = (uint16_t *)((uintptr_t)(&outbuf[0] + 31) & ~31);
+
+    while (width > 0) {
+        int n = width < CONVERT_CHUNK_PIXELS ? width : CONVERT_CHUNK_PIXELS;
+        convert_8888_to_0565_row(ctx, convbuf, (const uint32_t *)src, n, x, y);
+        ctx->writeback(n * 2, dst, convbuf);
+        src += n * 4;
+        dst += n * 2;
+        x += n;
+        width -= n;
+    }
+}
+
+static void
+shadow_band_job(void *arg, int job)
+{
+    shadow_band_job_t *band = (shadow_band_job_t *)arg;
+    int first_row = job * band->rows_per_job;
+    int rows = band->height - first_row;
+    int y = band->y + first_row;
+    uint8_t *dst = band->dst_bytes + first_row * band->dst_stride;
+    uint8_t *src = band->src_bytes + first_row * band->src_stride;
+    if (rows > band->rows_per_job)
+        rows = band->rows_per_job;
+    while (--rows >= 0) {
+        if (band->src_bytespp == band->dst_bytespp) {
+            band->ctx->writeback(band->width * band->src_bytespp, dst, src);
+        }
+        else {
+            shadow_convert_row(band->ctx, dst, src, band->width,
+                               band->x, y++);
+        }
+        dst += band->dst_stride;
+        src += band->src_stride;
+    }
+}
+
+static void
+shadow_copy_rect(cpu_backend_t     *ctx,
+                 shadow_band_job_t *band,
+                 uint8_t           *src_bytes,
+                 uint8_t           *dst_bytes,
+                 const blt2d_box_t *box)
+{
+    int njobs = 1;
+    int row_bytes;
+
+    band->x            = box->x1;
+    band->y            = box->y1;
+    band->width        = box->x2 - box->x1;
+    band->height       = box->y2 - box->y1;
+    band->rows_per_job = band->height;
+    band->dst_bytes    = dst_bytes + box->y1 * band->dst_stride +
+                                     box->x1 * band->dst_bytespp;
+    band->src_bytes    = src_bytes + box->y1 * band->src_stride +
+                                     box->x1 * band->src_bytespp;
+    row_bytes          = band->width * band->dst_bytespp;
+
+    if (ctx->worker_pool && band->height >= 2 &&
+        (uint64_t)row_bytes * band->height >=
+                                (uint64_t)ctx->parallel_blt_threshold)
+    {
+        int nthreads = worker_pool_nthreads(ctx->worker_pool);
+        int min_rows = PARALLEL_BLT_MIN_BAND_SIZE / row_bytes + 1;
+        band->rows_per_job = (band->height + nthreads - 1) / nthreads;
+        if (band->rows_per_job < min_rows)
+            band->rows_per_job = min_rows;
+        njobs = (band->height + band->rows_per_job - 1) / band->rows_per_job;
+    }
+
+    if (njobs > 1)
+        worker_pool_run(ctx->worker_pool, njobs, shadow_band_job, band);
+    else
+        shadow_band_job(band, 0);
+}
+
+static always_inline int64_t
+box_area(const blt2d_box_t *box)
+{
+    return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+int cpu_backend_shadow_update(cpu_backend_t     *ctx,
+                              uint32_t          *src_bits,
+                              uint32_t          *dst_bits,
+                              int                src_stride,
+                              int                dst_stride,
+                              int                src_bpp,
+                              int                dst_bpp,
+                              const blt2d_box_t *boxes,
+                              int                nboxes)
+{
+    shadow_band_job_t band;
+    blt2d_box_t rect, merged;
+    int64_t damaged_area;
+    int i;
+
+    if (src_stride < 0 || dst_stride < 0 || !ctx->writeback)
+        return 0;
+    if (!(src_bpp == dst_bpp && (src_bpp & 7) == 0) &&
+        !(src_bpp == 32 && dst_bpp == 16))
+        return 0;
+    if (nboxes <= 0)
+        return 1;
+
+    band.ctx         = ctx;
+    band.dst_stride  = (uintptr_t)dst_stride * 4;
+    band.src_stride  = (uintptr_t)src_stride * 4;
+    band.src_bytespp = src_bpp >> 3;
+    band.dst_bytespp = dst_bpp >> 3;
+
+    rect = boxes[0];
+    damaged_area = box_area(&rect);
+    for (i = 1; i < nboxes; i++) {
+        const blt2d_box_t *b = &boxes[i];
+        merged.x1 = b->x1 < rect.x1 ? b->x1 : rect.x1;
+        merged.y1 = b->y1 < rect.y1 ? b->y1 : rect.y1;
+        merged.x2 = b->x2 > rect.x2 ? b->x2 : rect.x2;
+        merged.y2 = b->y2 > rect.y2 ? b->y2 : rect.y2;
+        /* Merge as long as at least a half of the area is damaged */
+        if (box_area(&merged) <= 2 * (damaged_area + box_area(b))) {
+            rect = merged;
+            damaged_area += box_area(b);
+        }
+        else {
+            shadow_copy_rect(ctx, &band, (uint8_t *)src_bits,
+                             (uint8_t *)dst_bits, &rect);
+            rect = *b;
+            damaged_area = box_area(b);
+        }
+    }
+    shadow_copy_rect(ctx, &band, (uint8_t *)src_bits, (uint8_t *)dst_bits,
+                     &rect);
+    return 1;
+}
+
+/*
+ * All the fetch/writeback kernel pairs, which can be picked by calibration.
+ */
+
+enum {
+    KERNEL_NEEDS_NOTHING,
+    KERNEL_NEEDS_ARM_EDSP,
+    KERNEL_NEEDS_ARM_VFP,
+    KERNEL_NEEDS_ARM_NEON,
+    KERNEL_NEEDS_X86_SSE2,
+    KERNEL_NEEDS_X86_SSE41,
+    KERNEL_NEEDS_X86_AVX2,
+};
+
+typedef struct {
+    /* The short name used in the cache file */
+    const char *id;
+    /* The user-friendly name (usable for logs, etc.) */
+    const char *name;
+    int         needs;
+    void      (*twopass_memmove)(void *, const void *, size_t);
+    /* The fetch/writeback pair used by twopass_memmove */
+    void      (*fetch)(int, void *, const void *);
+    void      (*writeback)(int, void *, const void *);
+} twopass_kernel_t;
+
+static const twopass_kernel_t twopass_kernels[] = {
+#ifdef __arm__
+    { "neon",     "ARM NEON",     KERNEL_NEEDS_ARM_NEON,  twopass_memmove_neon,
+      aligned_fetch_fbmem_to_scratch_neon, writeback_scratch_to_mem_neon },
+    { "vfp",      "ARM VFP",      KERNEL_NEEDS_ARM_VFP,   twopass_memmove_vfp,
+      aligned_fetch_fbmem_to_scratch_vfp, writeback_scratch_to_mem_arm },
+    { "arm",      "ARM LDM/STM",  KERNEL_NEEDS_ARM_EDSP,  twopass_memmove_arm,
+      aligned_fetch_fbmem_to_scratch_arm, writeback_scratch_to_mem_arm },
+#endif
+#ifdef __aarch64__
+    { "a64_neon", "AArch64 NEON", KERNEL_NEEDS_NOTHING,   twopass_memmove_a64_neon,
+      aligned_fetch_fbmem_to_scratch_a64_neon, writeback_scratch_to_mem_a64 },
+    { "a64_ldp",  "AArch64 LDP",  KERNEL_NEEDS_NOTHING,   twopass_memmove_a64_ldp,
+      aligned_fetch_fbmem_to_scratch_a64_ldp, writeback_scratch_to_mem_a64 },
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+    { "avx2",     "x86 AVX2",     KERNEL_NEEDS_X86_AVX2,  twopass_memmove_avx2,
+      aligned_fetch_fbmem_to_scratch_avx2, writeback_scratch_to_mem_avx2 },
+    { "sse41",    "x86 SSE4.1",   KERNEL_NEEDS_X86_SSE41, twopass_memmove_sse41,
+      aligned_fetch_fbmem_to_scratch_sse41, writeback_scratch_to_mem_sse2 },
+    { "sse2",     "x86 SSE2",     KERNEL_NEEDS_X86_SSE2,  twopass_memmove_sse2,
+      aligned_fetch_fbmem_to_scratch_sse2, writeback_scratch_to_mem_sse2 },
+#endif
+    { "c",        "generic C",    KERNEL_NEEDS_NOTHING,   twopass_memmove_c,
+      aligned_fetch_fbmem_to_scratch_c, writeback_scratch_to_mem_c },
+};
+
+#define TWOPASS_KERNELS_COUNT \
+    ((int)(sizeof(twopass_kernels) / sizeof(twopass_kernels[0])))
+
+static int
+kernel_is_supported(cpuinfo_t *cpuinfo, const twopass_kernel_t *kernel)
+{
+    switch (kernel->needs) {
+    case KERNEL_NEEDS_ARM_EDSP:
+        return cpuinfo->has_arm_edsp;
+    case KERNEL_NEEDS_ARM_VFP:
+        return cpuinfo->has_arm_vfp && cpuinfo->has_arm_edsp;
+    case KERNEL_NEEDS_ARM_NEON:
+        return cpuinfo->has_arm_neon;
+    case KERNEL_NEEDS_X86_SSE2:
+        return cpuinfo->has_x86_sse2;
+    case KERNEL_NEEDS_X86_SSE41:
+        return cpuinfo->has_x86_sse41;
+    case KERNEL_NEEDS_X86_AVX2:
+        return cpuinfo->has_x86_avx2;
+    default:
+        return 1;
+    }
+}
+
+static const twopass_kernel_t *
+find_kernel(cpuinfo_t *cpuinfo, const char *id)
+{
+    int i;
+    for (i = 0; i < TWOPASS_KERNELS_COUNT; i++) {
+        if (strcmp(twopass_kernels[i].id, id) == 0 &&
+            kernel_is_supported(cpuinfo, &twopass_kernels[i]))
+            return &twopass_kernels[i];
+    }
+    return NULL;
+}
+
+static void
+install_kernel(cpu_backend_t *ctx, int size_class,
+               const twopass_kernel_t *kernel)
+{
+    ctx->size_class_memmove[size_class] = kernel->twopass_memmove;
+    ctx->size_class_name[size_class]    = kernel->name;
+    if (size_class == CPU_BACKEND_SIZE_CLASSES - 1) {
+        ctx->fetch     = kernel->fetch;
+        ctx->writeback = kernel->writeback;
+    }
+}
+
+/*
+ * The key identifying the CPU in the calibration cache file. It can't
+ * contain whitespaces.
+ */
+static void
+get_cache_key(cpuinfo_t *cpuinfo, char *key, size_t key_size)
+{
+    char *p;
+    snprintf(key, key_size, "%02X:%X:%X:%03X:%X:%d%d%d%d%d%d%d:%s",
+             cpuinfo->arm_implementer, cpuinfo->arm_architecture,
+             cpuinfo->arm_variant, cpuinfo->arm_part, cpuinfo->arm_revision,
+             cpuinfo->has_arm_edsp, cpuinfo->has_arm_vfp,
+             cpuinfo->has_arm_neon, cpuinfo->has_arm_wmmx,
+             cpuinfo->has_x86_sse2, cpuinfo->has_x86_sse41,
+             cpuinfo->has_x86_avx2, cpuinfo->processor_name);
+    for (p = key; *p; p++) {
+        if (*p == ' ' || *p == '\t' || *p == '\n')
+            *p = '_';
+    }
+}
+
+/*
+ * The cache file consists of a single line with the CPU key followed by
+ * the ids of the kernels for each size class.
+ */
+static int
+load_calibration(cpu_backend_t *ctx, const char *cache_file)
+{
+    char key[256], buf[512];
+    const twopass_kernel_t *kernels[CPU_BACKEND_SIZE_CLASSES];
+    char *tok, *saveptr;
+    FILE *f;
+    int i;
+
+    if (!(f = fopen(cache_file, "r")))
+        return 0;
+    if (!fgets(buf, sizeof(buf), f)) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    get_cache_key(ctx->cpuinfo, key, sizeof(key));
+    tok = strtok_r(buf, " \t\n", &saveptr);
+    if (!tok || strcmp(tok, key) != 0)
+        return 0;
+
+    for (i = 0; i < CPU_BACKEND_SIZE_CLASSES; i++) {
+        tok = strtok_r(NULL, " \t\n", &saveptr);
+        if (!tok || !(kernels[i] = find_kernel(ctx->cpuinfo, tok)))
+            return 0;
+    }
+
+    for (i = 0; i < CPU_BACKEND_SIZE_CLASSES; i++)
+        install_kernel(ctx, i, kernels[i]);
+    return 1;
+}
+
+static void
+save_calibration(cpu_backend_t *ctx, const char *cache_file,
+                 const twopass_kernel_t **kernels)
+{
+    char key[256];
+    FILE *f;
+    int i;
+
+    if (!(f = fopen(cache_file, "w")))
+        return;
+    get_cache_key(ctx->cpuinfo, key, sizeof(key));
+    fprintf(f, "%s", key);
+    for (i = 0; i < CPU_BACKEND_SIZE_CLASSES; i++)
+        fprintf(f, " %s", kernels[i]->id);
+    fprintf(f, "\n");
+    fclose(f);
+}
+
+/* The number of bytes copied by a single measurement */
+#define CALIBRATION_BYTES  (128 * 1024)
+/* The best of this many measurements is used */
+#define CALIBRATION_RUNS   3
+
+/*
+ * Return the time (in nanoseconds) needed to copy CALIBRATION_BYTES
+ * with 'row_size' bytes per operation. The data is copied in place,
+ * so the framebuffer contents do not change. The source alignment is
+ * varied to also cover the unaligned fetch path.
+ */
+static uint64_t
+measure_kernel(const twopass_kernel_t *kernel, uint8_t *area,
+               size_t area_size, size_t row_size)
+{
+    struct timespec t1, t2;
+    uint64_t best = UINT64_MAX, t;
+    size_t offs, total;
+    int run, i;
+
+    for (run = 0; run < CALIBRATION_RUNS; run++) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        offs = 0;
+        for (total = 0, i = 0; total < CALIBRATION_BYTES; total += row_size, i++) {
+            if (offs + row_size + 64 > area_size)
+                offs = 0;
+            kernel->twopass_memmove(area + offs + (i * 4 & 31),
+                                    area + offs + (i * 4 & 31), row_size);
+            offs += row_size + 32;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        t = (uint64_t)(t2.tv_sec - t1.tv_sec) * 1000000000 +
+            t2.tv_nsec - t1.tv_nsec;
+        if (t < best)
+            best = t;
+    }
+    return best;
+}
+
+int cpu_backend_calibrate(cpu_backend_t *ctx, const char *cache_file)
+{
+    static const size_t row_sizes[CPU_BACKEND_SIZE_CLASSES] = { 128, 1024, 4096 };
+    const twopass_kernel_t *best_kernels[CPU_BACKEND_SIZE_CLASSES];
+    uint64_t best_time[CPU_BACKEND_SIZE_CLASSES];
+    size_t area_size = ctx->uncached_area_end - ctx->uncached_area_begin;
+    int i, j;
+
+    if (!ctx->uncached_area_begin || area_size < 2 * row_sizes[2] + 64)
+        return -1;
+
+    if (cache_file && load_calibration(ctx, cache_file)) {
+        ctx->blt2d.overlapped_blt = overlapped_blt_calibrated;
+        ctx->blt2d_name = "calibrated";
+        return 1;
+    }
+
+    for (j = 0; j < CPU_BACKEND_SIZE_CLASSES; j++) {
+        best_kernels[j] = NULL;
+        best_time[j]    = UINT64_MAX;
+    }
+
+    for (i = 0; i < TWOPASS_KERNELS_COUNT; i++) {
+        const twopass_kernel_t *kernel = &twopass_kernels[i];
+        if (!kernel_is_supported(ctx->cpuinfo, kernel))
+            continue;
+        for (j = 0; j < CPU_BACKEND_SIZE_CLASSES; j++) {
+            uint64_t t = measure_kernel(kernel, ctx->uncached_area_begin,
+                                        area_size, row_sizes[j]);
+            if (t < best_time[j]) {
+                best_time[j]    = t;
+                best_kernels[j] = kernel;
+            }
+        }
+    }
+
+    for (j = 0; j < CPU_BACKEND_SIZE_CLASSES; j++)
+        install_kernel(ctx, j, best_kernels[j]);
+    ctx->blt2d.overlapped_blt = overlapped_blt_calibrated;
+    ctx->blt2d_name = "calibrated";
+
+    if (cache_file)
+        save_calibration(ctx, cache_file, best_kernels);
+    return 0;
+}
+
+int cpu_backend_select_kernel(cpu_backend_t *ctx, int index)
+{
+    int j;
+    if (index < 0 || index >= TWOPASS_KERNELS_COUNT)
+        return -1;
+    if (!kernel_is_supported(ctx->cpuinfo, &twopass_kernels[index]))
+        return 0;
+
+    for (j = 0; j < CPU_BACKEND_SIZE_CLASSES; j++)
+        install_kernel(ctx, j, &twopass_kernels[index]);
+    ctx->blt2d.overlapped_blt = overlapped_blt_calibrated;
+    ctx->blt2d_name = twopass_kernels[index].name;
+    return 1;
+}
+
+int cpu_backend_select_simd(cpu_backend_t *ctx, int use_simd)
+{
+    ctx->transpose_8x8_16bpp = transpose_8x8_16bpp_c;
+    ctx->transpose_8x8_32bpp = transpose_8x8_32bpp_c;
+    ctx->convert_8888_to_0565 = convert_8888_to_0565_c;
+    if (!use_simd)
+        return 1;
+#ifdef __arm__
+    if (ctx->cpuinfo->has_arm_neon) {
+        ctx->transpose_8x8_16bpp = transpose_8x8_16bpp_neon;
+        ctx->transpose_8x8_32bpp = transpose_8x8_32bpp_neon;
+        ctx->convert_8888_to_0565 = convert_8888_to_0565_neon;
+        return 1;
+    }
+#endif
+#ifdef __aarch64__
+    ctx->convert_8888_to_0565 = convert_8888_to_0565_a64_neon;
+    return 1;
+#endif
     return 0;
 }
 
@@ -293,6 +1722,9 @@ cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer,
                                 size_t   uncached_buffer_size)
 {
     cpu_backend_t *ctx = calloc(sizeof(cpu_backend_t), 1);
+    void (*twopass_memmove)(void *, const void *, size_t);
+    long nthreads;
+    int i, j;
     if (!ctx)
         return NULL;
 
@@ -300,9 +1732,21 @@ cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer,
     ctx->uncached_area_end   = uncached_buffer + uncached_buffer_size;
 
     ctx->blt2d.self = ctx;
-    ctx->blt2d.overlapped_blt = overlapped_blt_noop;
+    ctx->blt2d.overlapped_blt = overlapped_blt_c;
+    twopass_memmove = twopass_memmove_c;
+    ctx->blt2d.fill = fill_c;
+    ctx->blt2d.blt_boxes = blt_boxes;
+    ctx->blt2d_name = "generic C";
 
     ctx->cpuinfo = cpuinfo_init();
+    cpu_backend_select_simd(ctx, 1);
+
+    /* The worker threads for large blits on multi-core systems */
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > CPU_BACKEND_MAX_THREADS)
+        nthreads = CPU_BACKEND_MAX_THREADS;
+    ctx->worker_pool = worker_pool_init(nthreads);
+    ctx->parallel_blt_threshold = PARALLEL_BLT_DEFAULT_THRESHOLD;
 
 #ifdef __arm__
     if (ctx->cpuinfo->has_arm_neon &&
@@ -311,22 +1755,91 @@ cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer,
     {
         /* NEON works better on Cortex-A8 */
         ctx->blt2d.overlapped_blt = overlapped_blt_neon;
+        twopass_memmove = twopass_memmove_neon;
+        ctx->blt2d_name = "ARM NEON";
     }
     else if (ctx->cpuinfo->has_arm_wmmx) {
         /* ARM LDM/STM works better than VFP/WMMX on Marvell PJ4 */
         ctx->blt2d.overlapped_blt = overlapped_blt_arm;
+        twopass_memmove = twopass_memmove_arm;
+        ctx->blt2d_name = "ARM LDM/STM";
     }
     else if (ctx->cpuinfo->has_arm_vfp && ctx->cpuinfo->has_arm_edsp) {
         /* VFP works better on Cortex-A9, Cortex-A15 and maybe everything else */
         ctx->blt2d.overlapped_blt = overlapped_blt_vfp;
+        twopass_memmove = twopass_memmove_vfp;
+        ctx->blt2d_name = "ARM VFP";
     }
+
+    /* Solid fills only need wide aligned stores */
+    if (ctx->cpuinfo->has_arm_neon)
+        ctx->blt2d.fill = fill_neon;
+    else if (ctx->cpuinfo->has_arm_vfp)
+        ctx->blt2d.fill = fill_vfp;
+    else if (ctx->cpuinfo->has_arm_edsp)
+        ctx->blt2d.fill = fill_arm;
 #endif
 
+#ifdef __aarch64__
+    /* NEON is always available on AArch64, only pick the load instructions */
+    if (ctx->cpuinfo->arm_implementer == 0x41 &&
+        (ctx->cpuinfo->arm_part == 0xD03 || ctx->cpuinfo->arm_part == 0xD04 ||
+         ctx->cpuinfo->arm_part == 0xD05))
+    {
+        /* Use LD1 with four registers on in-order Cortex-A53/A35/A55 */
+        ctx->blt2d.overlapped_blt = overlapped_blt_a64_neon;
+        twopass_memmove = twopass_memmove_a64_neon;
+        ctx->blt2d_name = "AArch64 NEON";
+    }
+    else {
+        /* And LDP on out-of-order cores and everything else */
+        ctx->blt2d.overlapped_blt = overlapped_blt_a64_ldp;
+        twopass_memmove = twopass_memmove_a64_ldp;
+        ctx->blt2d_name = "AArch64 LDP";
+    }
+    ctx->blt2d.fill = fill_a64;
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+    if (ctx->cpuinfo->has_x86_avx2) {
+        /* 256-bit non-temporal MOVNTDQA loads from the framebuffer */
+        ctx->blt2d.overlapped_blt = overlapped_blt_avx2;
+        twopass_memmove = twopass_memmove_avx2;
+        ctx->blt2d_name = "x86 AVX2";
+    }
+    else if (ctx->cpuinfo->has_x86_sse41) {
+        /* 128-bit non-temporal MOVNTDQA loads from the framebuffer */
+        ctx->blt2d.overlapped_blt = overlapped_blt_sse41;
+        twopass_memmove = twopass_memmove_sse41;
+        ctx->blt2d_name = "x86 SSE4.1";
+    }
+    else if (ctx->cpuinfo->has_x86_sse2) {
+        ctx->blt2d.overlapped_blt = overlapped_blt_sse2;
+        twopass_memmove = twopass_memmove_sse2;
+        ctx->blt2d_name = "x86 SSE2";
+    }
+
+    if (ctx->cpuinfo->has_x86_avx2)
+        ctx->blt2d.fill = fill_avx2;
+    else if (ctx->cpuinfo->has_x86_sse2)
+        ctx->blt2d.fill = fill_sse2;
+#endif
+
+    /* Without calibration, all size classes use the same kernel */
+    for (i = 0; i < TWOPASS_KERNELS_COUNT; i++) {
+        if (twopass_kernels[i].twopass_memmove == twopass_memmove) {
+            for (j = 0; j < CPU_BACKEND_SIZE_CLASSES; j++)
+                install_kernel(ctx, j, &twopass_kernels[i]);
+        }
+    }
+
     return ctx;
 }
 
 void cpu_backend_close(cpu_backend_t *ctx)
 {
+    if (ctx->worker_pool)
+        worker_pool_close(ctx->worker_pool);
     if (ctx->cpuinfo)
         cpuinfo_close(ctx->cpuinfo);
 
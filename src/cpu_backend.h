@@ -28,6 +28,19 @@
 
 #include "cpuinfo.h"
 #include "interfaces.h"
+#include "worker_pool.h"
+
+/*
+ * The overlapped_blt operations are split into size classes by the number
+ * of bytes per row, each one may use its own fetch/writeback kernel pair:
+ *     small  : less than 256 bytes
+ *     medium : less than 2048 bytes
+ *     large  : everything else
+ */
+#define CPU_BACKEND_SIZE_CLASSES 3
+
+/* The maximal number of threads used for a single operation */
+#define CPU_BACKEND_MAX_THREADS 4
 
 /*
  * A set of CPU specific optimizations for different operations.
@@ -42,9 +55,112 @@ typedef struct {
     uint8_t   *uncached_area_end;
     /* An accelerated implementation of blt2d_i interface */
     blt2d_i    blt2d;
+    /* The name of the selected implementation (usable for logs, etc.) */
+    const char *blt2d_name;
+    /* The kernels used for each size class (see cpu_backend_calibrate) */
+    void      (*size_class_memmove[CPU_BACKEND_SIZE_CLASSES])(void *dst,
+                                                              const void *src,
+                                                              size_t size);
+    const char *size_class_name[CPU_BACKEND_SIZE_CLASSES];
+    /* The fetch/writeback pair of the large size class, which is also used
+     * by the format converting blits and the shadow framebuffer updates */
+    void      (*fetch)(int size, void *dst, const void *src);
+    void      (*writeback)(int size, void *dst, const void *src);
+    /* Use ordered dithering for 32bpp to 16bpp conversion */
+    int         dither_32_to_16;
+    /* The worker threads for splitting large operations (may be NULL) */
+    worker_pool_t *worker_pool;
+    /* The overlapped_blt operations copying at least this many bytes
+     * are split into row bands and processed by the worker threads */
+    int         parallel_blt_threshold;
+    /* Transpose 8x8 pixels (strides are in bytes and may be negative) */
+    void      (*transpose_8x8_16bpp)(void *dst, int dst_stride,
+                                     const void *src, int src_stride);
+    void      (*transpose_8x8_32bpp)(void *dst, int dst_stride,
+                                     const void *src, int src_stride);
+    /* Convert x8r8g8b8 to r5g6b5 ('width' is a multiple of 8), adding
+     * 'dither[i % 8]' to red and blue and 'dither[8 + i % 8]' to green */
+    void      (*convert_8888_to_0565)(uint16_t *dst, const uint32_t *src,
+                                      int width, const uint8_t *dither);
 } cpu_backend_t;
 
 cpu_backend_t *cpu_backend_init(uint8_t *uncached_buffer, size_t uncached_buffer_size);
+
+/*
+ * Time all the fetch/writeback kernel pairs supported by this CPU on the
+ * uncached area and install the fastest one for each size class. The
+ * framebuffer contents are preserved (data is copied in place), but this
+ * should be only done when nobody else is drawing to it.
+ *
+ * If 'cache_file' is not NULL, it is first checked for the results of
+ * an earlier calibration on the same CPU. Fresh results are saved there.
+ *
+ * Returns 1 if the results have been loaded from the cache file, 0 if
+ * the kernels have been measured and -1 if calibration was not possible.
+ */
+int cpu_backend_calibrate(cpu_backend_t *cpu_backend, const char *cache_file);
+
+/*
+ * Install the fetch/writeback kernel pair number 'index' for all size
+ * classes, bypassing the heuristics and calibration (intended for the
+ * tests, which need to check every kernel compiled in for this CPU).
+ *
+ * Returns 1 on success, 0 if the kernel is not supported by this CPU
+ * and -1 if there is no kernel with such index.
+ */
+int cpu_backend_select_kernel(cpu_backend_t *cpu_backend, int index);
+
+/*
+ * Install the generic C (if 'use_simd' is 0) or the SIMD variants of the
+ * transpose and 32bpp to 16bpp conversion kernels. The SIMD ones are used
+ * by default, this is intended for the tests comparing them.
+ *
+ * Returns 1 on success, 0 if there are no SIMD variants for this CPU (the
+ * C kernels are installed then).
+ */
+int cpu_backend_select_simd(cpu_backend_t *cpu_backend, int use_simd);
+
+/*
+ * Copy the rectangle (x, y, w, h) from the source image, which has the size
+ * 'src_width' x 'src_height', to the destination rotated by 'rotation'
+ * degrees counter-clockwise (90, 180 or 270, the same as in RandR). The
+ * strides are in 32-bit units. Supports 8, 16 and 32 bpp.
+ *
+ * Returns 0 if the operation is not supported.
+ */
+int cpu_backend_rotated_blt(cpu_backend_t *cpu_backend,
+                            uint32_t      *src_bits,
+                            uint32_t      *dst_bits,
+                            int            src_stride,
+                            int            dst_stride,
+                            int            bpp,
+                            int            rotation,
+                            int            src_width,
+                            int            src_height,
+                            int            x,
+                            int            y,
+                            int            w,
+                            int            h);
+
+/*
+ * Copy the damaged boxes from a shadow framebuffer (in cached memory) to
+ * the framebuffer at the same coordinates. Neighbouring boxes are merged
+ * into larger rectangles, and the large ones are split between the worker
+ * threads. Returns only after everything has been copied. The strides are
+ * in 32-bit units. Either both bpp values are the same, or a 32bpp shadow
+ * framebuffer is converted to 16bpp (dithered if dither_32_to_16 is set).
+ *
+ * Returns 0 if the operation is not supported.
+ */
+int cpu_backend_shadow_update(cpu_backend_t     *cpu_backend,
+                              uint32_t          *src_bits,
+                              uint32_t          *dst_bits,
+                              int                src_stride,
+                              int                dst_stride,
+                              int                src_bpp,
+                              int                dst_bpp,
+                              const blt2d_box_t *boxes,
+                              int                nboxes);
 void cpu_backend_close(cpu_backend_t *cpu_backend);
 
 #endif
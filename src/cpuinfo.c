@@ -96,6 +96,17 @@ static int parse_proc_cpuinfo(cpuinfo_t *cpuinfo)
             cpuinfo->has_arm_vfp  = find_feature(val, "vfp");
             cpuinfo->has_arm_neon = find_feature(val, "neon");
             cpuinfo->has_arm_wmmx = find_feature(val, "iwmmxt");
+#ifdef __aarch64__
+            /* 64-bit kernels report "fp" and "asimd" instead */
+            cpuinfo->has_arm_vfp  = find_feature(val, "fp");
+            cpuinfo->has_arm_neon = find_feature(val, "asimd");
+#endif
+        }
+        else if ((val = cpuinfo_match_prefix(buffer, "flags"))) {
+            /* x86 processors list their features here */
+            cpuinfo->has_x86_sse2  = find_feature(val, "sse2");
+            cpuinfo->has_x86_sse41 = find_feature(val, "sse4_1");
+            cpuinfo->has_x86_avx2  = find_feature(val, "avx2");
         }
         else if ((val = cpuinfo_match_prefix(buffer, "CPU implementer"))) {
             if (sscanf(val, "%i", &cpuinfo->arm_implementer) != 1) {
@@ -43,16 +43,54 @@
  * fbdev kernel driver actually returns errors on unsupported ioctls.
  */
 #define FBUNSUPPORTED		_IOW('z', 0x22, struct fb_copyarea)
+/*
+ * HACK: optional non-standard ioctl, which does an array of fb_copyarea
+ * copies in the order, saving the system call overhead for each of them.
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t areas;    /* the address of 'count' fb_copyarea structures */
+} fb_copyarea_multi_t;
+#define FBIOCOPYAREA_MULTI	_IOW('z', 0x23, fb_copyarea_multi_t)
+/*
+ * HACK: optional non-standard ioctl, which provides access to fb_fillrect
+ * accelerated function in the kernel. It accepts the standard fb_fillrect
+ * structure, but the 'color' field is the pixel value (not an index in the
+ * pseudo palette) and 'rop' is always ROP_COPY.
+ */
+#define FBIOFILLRECT		_IOW('z', 0x24, struct fb_fillrect)
 
-/* Fallback to CPU when handling less than COPYAREA_BLT_SIZE_THRESHOLD pixels */
+/*
+ * Fallback to CPU when handling less than COPYAREA_BLT_SIZE_THRESHOLD pixels
+ * (this is the initial value with fb_copyarea_enable_tuning)
+ */
 #define COPYAREA_BLT_SIZE_THRESHOLD 90
 
+/* Fallback to CPU when filling less than COPYAREA_FILL_SIZE_THRESHOLD pixels */
+#define COPYAREA_FILL_SIZE_THRESHOLD 2000
+
+/* The maximal number of copies done by fb_copyarea_blt_boxes at once */
+#define COPYAREA_BATCH_SIZE 32
+
+/* A queued copy or fill */
+typedef struct {
+    int is_fill;
+    int tune_slot; /* the blt_tuner slot or -1 */
+    union {
+        struct fb_copyarea area;
+        struct fb_fillrect fill;
+    } arg;
+} fb_copyarea_request_t;
+
 fb_copyarea_t *fb_copyarea_init(const char *device, void *xserver_fbmem)
 {
     fb_copyarea_t *ctx = calloc(sizeof(fb_copyarea_t), 1);
     struct fb_var_screeninfo fb_var;
     struct fb_fix_screeninfo fb_fix;
     struct fb_copyarea copyarea;
+    fb_copyarea_multi_t multi;
+    struct fb_fillrect fillrect;
 
     /* use /dev/fb0 by default */
     if (!device)
@@ -90,6 +128,13 @@ fb_copyarea_t *fb_copyarea_init(const char *device, void *xserver_fbmem)
         ctx->do_copyarea = 0;
     }
 
+    /* Check the optional FBIOCOPYAREA_MULTI ioctl in the same way */
+    multi.count = 1;
+    multi.reserved = 0;
+    multi.areas = (uintptr_t)&copyarea;
+    if (ctx->do_copyarea && ioctl(ctx->fd, FBIOCOPYAREA_MULTI, &multi) == 0)
+        ctx->do_copyarea_multi = 1;
+
     if (ioctl(ctx->fd, FBIOGET_VSCREENINFO, &fb_var) < 0 ||
         ioctl(ctx->fd, FBIOGET_FSCREENINFO, &fb_fix) < 0)
     {
@@ -139,18 +184,240 @@ fb_copyarea_t *fb_copyarea_init(const char *device, void *xserver_fbmem)
         }
     }
 
+    /*
+     * Check whether the FBIOFILLRECT ioctl is supported by filling the top
+     * left pixel with its own value
+     */
+    if (ctx->bits_per_pixel == 16 || ctx->bits_per_pixel == 32) {
+        fillrect.dx = 0;
+        fillrect.dy = 0;
+        fillrect.width = 1;
+        fillrect.height = 1;
+        fillrect.rop = ROP_COPY;
+        if (ctx->bits_per_pixel == 16)
+            fillrect.color = *(volatile uint16_t *)ctx->framebuffer_addr;
+        else
+            fillrect.color = *(volatile uint32_t *)ctx->framebuffer_addr;
+        if (ioctl(ctx->fd, FBIOFILLRECT, &fillrect) == 0)
+            ctx->do_fillrect = 1;
+    }
+
     ctx->blt2d.self = ctx;
     ctx->blt2d.overlapped_blt = fb_copyarea_blt;
+    ctx->blt2d.fill = fb_copyarea_fill;
+    ctx->blt2d.blt_boxes = fb_copyarea_blt_boxes;
 
     return ctx;
 }
 
 void fb_copyarea_close(fb_copyarea_t *ctx)
 {
+    if (ctx->queue) {
+        /* finish the queued copies */
+        submit_queue_close(ctx->queue);
+        ctx->queue = NULL;
+    }
+    if (ctx->tuner)
+        blt_tuner_close(ctx->tuner);
     close(ctx->fd);
     free(ctx);
 }
 
+int fb_copyarea_enable_tuning(fb_copyarea_t *ctx)
+{
+    if (ctx->bits_per_pixel < 8)
+        return -1;
+    ctx->tuner = blt_tuner_init(2);
+    if (!ctx->tuner)
+        return -1;
+    blt_tuner_set_kind(ctx->tuner, 0, "copyarea", ctx->bits_per_pixel / 8,
+                       COPYAREA_BLT_SIZE_THRESHOLD);
+    blt_tuner_set_kind(ctx->tuner, 1, "fillrect", ctx->bits_per_pixel / 8,
+                       COPYAREA_FILL_SIZE_THRESHOLD);
+    return 0;
+}
+
+/*
+ * Do the copies with the kernel, using a single FBIOCOPYAREA_MULTI ioctl if
+ * possible. The time is reported to the tuner for the copies with a valid
+ * slot. Returns the number of the leading copies, which are done.
+ */
+static int fb_copyarea_run(fb_copyarea_t             *ctx,
+                           const struct fb_copyarea  *areas,
+                           const int                 *tune_slots,
+                           int                        n)
+{
+    int bytes_per_pixel = ctx->bits_per_pixel / 8;
+    int64_t t0 = 0;
+    int i;
+
+    if (ctx->do_copyarea_multi && n > 1) {
+        fb_copyarea_multi_t multi;
+        int64_t ns;
+        int pixels = 0;
+        multi.count = n;
+        multi.reserved = 0;
+        multi.areas = (uintptr_t)areas;
+        if (ctx->tuner)
+            t0 = blt_tuner_time_ns();
+        if (ioctl(ctx->fd, FBIOCOPYAREA_MULTI, &multi) != 0)
+            return 0;
+        if (!ctx->tuner)
+            return n;
+        ns = blt_tuner_time_ns() - t0;
+        for (i = 0; i < n; i++)
+            pixels += areas[i].width * areas[i].height;
+        /* split the time between the copies according to their size */
+        for (i = 0; i < n; i++) {
+            int area_pixels = areas[i].width * areas[i].height;
+            if (tune_slots[i] >= 0)
+                blt_tuner_hw_sample(ctx->tuner, tune_slots[i],
+                                    area_pixels * bytes_per_pixel,
+                                    ns * area_pixels / pixels);
+        }
+        return n;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (tune_slots[i] >= 0)
+            t0 = blt_tuner_time_ns();
+        if (ioctl(ctx->fd, FBIOCOPYAREA, &areas[i]) != 0)
+            return i;
+        if (tune_slots[i] >= 0)
+            blt_tuner_hw_sample(ctx->tuner, tune_slots[i],
+                                areas[i].width * areas[i].height *
+                                bytes_per_pixel,
+                                blt_tuner_time_ns() - t0);
+    }
+    return n;
+}
+
+/* Do the fill with the kernel, reporting the time if 'tune_slot' is valid */
+static int fb_copyarea_run_fill(fb_copyarea_t             *ctx,
+                                const struct fb_fillrect  *fillrect,
+                                int                        tune_slot)
+{
+    int64_t t0 = 0;
+    if (tune_slot >= 0)
+        t0 = blt_tuner_time_ns();
+    if (ioctl(ctx->fd, FBIOFILLRECT, fillrect) != 0)
+        return 0;
+    if (tune_slot >= 0)
+        blt_tuner_hw_sample(ctx->tuner, tune_slot,
+                            fillrect->width * fillrect->height *
+                            (ctx->bits_per_pixel / 8),
+                            blt_tuner_time_ns() - t0);
+    return 1;
+}
+
+/*****************************************************************************
+ * Asynchronous submission of the copies and fills                            *
+ *****************************************************************************/
+
+/*
+ * The submit_queue callback. The runs of the consecutive copies are done
+ * with fb_copyarea_run (a single FBIOCOPYAREA_MULTI ioctl if possible).
+ */
+static int fb_copyarea_run_requests(void *self, void *requests, int n)
+{
+    fb_copyarea_t *ctx = (fb_copyarea_t *)self;
+    fb_copyarea_request_t *request = (fb_copyarea_request_t *)requests;
+    struct fb_copyarea areas[COPYAREA_BATCH_SIZE];
+    int tune_slots[COPYAREA_BATCH_SIZE];
+    int i = 0, count, done;
+
+    while (i < n) {
+        if (request[i].is_fill) {
+            if (!fb_copyarea_run_fill(ctx, &request[i].arg.fill,
+                                      request[i].tune_slot))
+                return i;
+            i++;
+            continue;
+        }
+        count = 0;
+        while (i + count < n && count < COPYAREA_BATCH_SIZE &&
+               !request[i + count].is_fill) {
+            areas[count] = request[i + count].arg.area;
+            tune_slots[count] = request[i + count].tune_slot;
+            count++;
+        }
+        done = fb_copyarea_run(ctx, areas, tune_slots, count);
+        i += done;
+        if (done < count)
+            return i;
+    }
+    return n;
+}
+
+int fb_copyarea_enable_async(fb_copyarea_t *ctx)
+{
+    if (!ctx->do_copyarea && !ctx->do_fillrect)
+        return -1;
+    if (ctx->queue)
+        return 0;
+
+    ctx->queue = submit_queue_init(sizeof(fb_copyarea_request_t),
+                                   fb_copyarea_run_requests, ctx);
+    if (!ctx->queue)
+        return -1;
+    ctx->blt2d.sync = fb_copyarea_sync;
+    return 0;
+}
+
+void fb_copyarea_sync(void *self)
+{
+    fb_copyarea_t *ctx = (fb_copyarea_t *)self;
+    if (ctx->queue)
+        submit_queue_sync(ctx->queue);
+}
+
+/*
+ * Do the copies or add them to the queue in the asynchronous mode (the
+ * arrays are copied, so the caller may reuse them). Returns the number of
+ * the leading copies, which are done or queued.
+ */
+static int fb_copyarea_submit(fb_copyarea_t             *ctx,
+                              const struct fb_copyarea  *areas,
+                              const int                 *tune_slots,
+                              int                        n)
+{
+    int i;
+
+    if (ctx->queue && submit_queue_begin(ctx->queue) == 0) {
+        for (i = 0; i < n; i++) {
+            fb_copyarea_request_t *request = submit_queue_add(ctx->queue);
+            request->is_fill = 0;
+            request->tune_slot = tune_slots[i];
+            request->arg.area = areas[i];
+        }
+        submit_queue_end(ctx->queue);
+        return n;
+    }
+
+    return fb_copyarea_run(ctx, areas, tune_slots, n);
+}
+
+/* The same as fb_copyarea_submit, but for a single fill */
+static int fb_copyarea_submit_fill(fb_copyarea_t             *ctx,
+                                   const struct fb_fillrect  *fillrect,
+                                   int                        tune_slot)
+{
+    if (ctx->queue && submit_queue_begin(ctx->queue) == 0) {
+        fb_copyarea_request_t *request = submit_queue_add(ctx->queue);
+        request->is_fill = 1;
+        request->tune_slot = tune_slot;
+        request->arg.fill = *fillrect;
+        submit_queue_end(ctx->queue);
+        return 1;
+    }
+
+    return fb_copyarea_run_fill(ctx, fillrect, tune_slot);
+}
+
+/*****************************************************************************
+ * The blt2d_i interface                                                     *
+ *****************************************************************************/
+
 static inline int try_fallback_blt(void               *self,
                                    uint32_t           *src_bits,
                                    uint32_t           *dst_bits,
@@ -166,13 +433,16 @@ static inline int try_fallback_blt(void               *self,
                                    int                 h)
 {
     fb_copyarea_t *ctx = (fb_copyarea_t *)self;
-    if (ctx->fallback_blt2d)
+    if (ctx->fallback_blt2d) {
+        /* the CPU must not overtake the queued copies */
+        fb_copyarea_sync(ctx);
         return ctx->fallback_blt2d->overlapped_blt(ctx->fallback_blt2d->self,
                                                    src_bits, dst_bits,
                                                    src_stride, dst_stride,
                                                    src_bpp, dst_bpp,
                                                    src_x, src_y,
                                                    dst_x, dst_y, w, h);
+    }
     return 0;
 }
 
@@ -182,6 +452,68 @@ static inline int try_fallback_blt(void               *self,
                                         dst_bpp, src_x, src_y, \
                                         dst_x, dst_y, w, h);
 
+/* Check whether FBIOCOPYAREA can handle the copies between these images */
+static int fb_copyarea_supported(fb_copyarea_t      *ctx,
+                                 uint32_t           *src_bits,
+                                 uint32_t           *dst_bits,
+                                 int                 src_stride,
+                                 int                 dst_stride,
+                                 int                 src_bpp,
+                                 int                 dst_bpp)
+{
+    return ctx->do_copyarea &&
+           src_bpp == dst_bpp && src_bpp == ctx->bits_per_pixel &&
+           src_stride == dst_stride && src_stride == ctx->framebuffer_stride &&
+           src_bits == dst_bits &&
+           src_bits == (uint32_t *)ctx->framebuffer_addr;
+}
+
+/*
+ * Decide whether the w x h copy is worth an ioctl. The tuner slot is
+ * stored in 'tune_slot' (-1 if there is no tuner).
+ */
+static int fb_copyarea_use_hw(fb_copyarea_t *ctx, int w, int h, int *tune_slot)
+{
+    int bytes_per_pixel = ctx->bits_per_pixel / 8;
+    *tune_slot = -1;
+    if (!ctx->tuner)
+        return w * h >= COPYAREA_BLT_SIZE_THRESHOLD;
+    *tune_slot = blt_tuner_slot(0, w * bytes_per_pixel);
+    return blt_tuner_use_hw(ctx->tuner, *tune_slot, w * h * bytes_per_pixel, 1);
+}
+
+/* The CPU fallback, which is timed for the tuner if 'tune_slot' is valid */
+static int fb_copyarea_cpu_blt(void               *self,
+                               int                 tune_slot,
+                               uint32_t           *src_bits,
+                               uint32_t           *dst_bits,
+                               int                 src_stride,
+                               int                 dst_stride,
+                               int                 src_bpp,
+                               int                 dst_bpp,
+                               int                 src_x,
+                               int                 src_y,
+                               int                 dst_x,
+                               int                 dst_y,
+                               int                 w,
+                               int                 h)
+{
+    fb_copyarea_t *ctx = (fb_copyarea_t *)self;
+    int64_t t0;
+    int done;
+
+    if (tune_slot < 0)
+        return FALLBACK_BLT();
+
+    fb_copyarea_sync(ctx);
+    t0 = blt_tuner_time_ns();
+    done = FALLBACK_BLT();
+    if (done)
+        blt_tuner_cpu_sample(ctx->tuner, tune_slot, w * h * (src_bpp / 8),
+                             blt_tuner_time_ns() - t0);
+    return done;
+}
+
 int fb_copyarea_blt(void               *self,
                     uint32_t           *src_bits,
                     uint32_t           *dst_bits,
@@ -198,32 +530,171 @@ int fb_copyarea_blt(void               *self,
 {
     fb_copyarea_t *ctx = (fb_copyarea_t *)self;
     struct fb_copyarea copyarea;
-    uint32_t *framebuffer_addr = (uint32_t *)ctx->framebuffer_addr;
+    int slot = -1;
 
     /* Zero size blit, nothing to do */
     if (w <= 0 || h <= 0)
         return 1;
 
-    if (!ctx->do_copyarea)
-        return FALLBACK_BLT();
-
-    if (src_bpp != dst_bpp || src_bpp != ctx->bits_per_pixel ||
-        src_stride != dst_stride || src_stride != ctx->framebuffer_stride ||
-        src_bits != dst_bits || src_bits != framebuffer_addr) {
-        return FALLBACK_BLT();
+    if (!fb_copyarea_supported(ctx, src_bits, dst_bits, src_stride,
+                               dst_stride, src_bpp, dst_bpp) ||
+        !fb_copyarea_use_hw(ctx, w, h, &slot))
+    {
+        return fb_copyarea_cpu_blt(self, slot, src_bits, dst_bits,
+                                   src_stride, dst_stride, src_bpp, dst_bpp,
+                                   src_x, src_y, dst_x, dst_y, w, h);
     }
 
-    if (w * h < COPYAREA_BLT_SIZE_THRESHOLD)
-        return FALLBACK_BLT();
-
     copyarea.sx = src_x;
     copyarea.sy = src_y;
     copyarea.dx = dst_x;
     copyarea.dy = dst_y;
     copyarea.width = w;
     copyarea.height = h;
-    if (ioctl(ctx->fd, FBIOCOPYAREA, &copyarea) == 0)
+    return fb_copyarea_submit(ctx, &copyarea, &slot, 1) == 1;
+}
+
+static inline int try_fallback_fill(void               *self,
+                                    uint32_t           *bits,
+                                    int                 stride,
+                                    int                 bpp,
+                                    int                 x,
+                                    int                 y,
+                                    int                 w,
+                                    int                 h,
+                                    uint32_t            filler)
+{
+    fb_copyarea_t *ctx = (fb_copyarea_t *)self;
+    if (ctx->fallback_blt2d) {
+        /* the CPU must not overtake the queued requests */
+        fb_copyarea_sync(ctx);
+        return ctx->fallback_blt2d->fill(ctx->fallback_blt2d->self,
+                                         bits, stride, bpp,
+                                         x, y, w, h, filler);
+    }
+    return 0;
+}
+
+#define FALLBACK_FILL() try_fallback_fill(self, bits, stride, bpp, \
+                                          x, y, w, h, filler);
+
+int fb_copyarea_fill(void               *self,
+                     uint32_t           *bits,
+                     int                 stride,
+                     int                 bpp,
+                     int                 x,
+                     int                 y,
+                     int                 w,
+                     int                 h,
+                     uint32_t            filler)
+{
+    fb_copyarea_t *ctx = (fb_copyarea_t *)self;
+    struct fb_fillrect fillrect;
+    int bytes_per_pixel = bpp / 8;
+    int slot = -1;
+
+    /* Zero size fill, nothing to do */
+    if (w <= 0 || h <= 0)
         return 1;
-    else
-        return 0;
+
+    if (!ctx->do_fillrect || bpp != ctx->bits_per_pixel ||
+        stride != ctx->framebuffer_stride ||
+        bits != (uint32_t *)ctx->framebuffer_addr)
+    {
+        return FALLBACK_FILL();
+    }
+
+    if (ctx->tuner) {
+        int64_t t0;
+        int done;
+        slot = blt_tuner_slot(1, w * bytes_per_pixel);
+        if (!blt_tuner_use_hw(ctx->tuner, slot, w * h * bytes_per_pixel, 1)) {
+            fb_copyarea_sync(ctx);
+            t0 = blt_tuner_time_ns();
+            done = FALLBACK_FILL();
+            if (done)
+                blt_tuner_cpu_sample(ctx->tuner, slot, w * h * bytes_per_pixel,
+                                     blt_tuner_time_ns() - t0);
+            return done;
+        }
+    }
+    else if (w * h < COPYAREA_FILL_SIZE_THRESHOLD) {
+        return FALLBACK_FILL();
+    }
+
+    fillrect.dx = x;
+    fillrect.dy = y;
+    fillrect.width = w;
+    fillrect.height = h;
+    fillrect.color = bpp == 16 ? (filler & 0xFFFF) : filler;
+    fillrect.rop = ROP_COPY;
+    return fb_copyarea_submit_fill(ctx, &fillrect, slot);
+}
+
+/*
+ * The blt2d_i::blt_boxes implementation. The adjacent boxes are merged and
+ * the ones, which are worth an ioctl, are submitted in batches (as a single
+ * FBIOCOPYAREA_MULTI ioctl if the kernel supports it). The small boxes are
+ * copied by the CPU after the preceding batch is finished.
+ */
+int fb_copyarea_blt_boxes(void               *self,
+                          uint32_t           *src_bits,
+                          uint32_t           *dst_bits,
+                          int                 src_stride,
+                          int                 dst_stride,
+                          int                 src_bpp,
+                          int                 dst_bpp,
+                          const blt2d_box_t  *boxes,
+                          int                 nboxes,
+                          int                 src_dx,
+                          int                 src_dy,
+                          int                 dst_dx,
+                          int                 dst_dy)
+{
+    fb_copyarea_t *ctx = (fb_copyarea_t *)self;
+    struct fb_copyarea areas[COPYAREA_BATCH_SIZE];
+    int tune_slots[COPYAREA_BATCH_SIZE];
+    int first_box[COPYAREA_BATCH_SIZE]; /* the box index of each copy */
+    int supported = fb_copyarea_supported(ctx, src_bits, dst_bits, src_stride,
+                                          dst_stride, src_bpp, dst_bpp);
+    int i = 0, n = 0, done;
+
+    while (i < nboxes) {
+        blt2d_box_t b;
+        int m = blt2d_merge_boxes(boxes + i, nboxes - i, &b);
+        int w = b.x2 - b.x1, h = b.y2 - b.y1;
+        int slot = -1;
+
+        if (supported && fb_copyarea_use_hw(ctx, w, h, &slot)) {
+            if (n == COPYAREA_BATCH_SIZE) {
+                if ((done = fb_copyarea_submit(ctx, areas, tune_slots, n)) < n)
+                    return first_box[done];
+                n = 0;
+            }
+            areas[n].sx = b.x1 + src_dx;
+            areas[n].sy = b.y1 + src_dy;
+            areas[n].dx = b.x1 + dst_dx;
+            areas[n].dy = b.y1 + dst_dy;
+            areas[n].width = w;
+            areas[n].height = h;
+            tune_slots[n] = slot;
+            first_box[n] = i;
+            n++;
+        }
+        else {
+            if (n > 0 &&
+                (done = fb_copyarea_submit(ctx, areas, tune_slots, n)) < n)
+                return first_box[done];
+            n = 0;
+            if (!fb_copyarea_cpu_blt(self, slot, src_bits, dst_bits,
+                                     src_stride, dst_stride, src_bpp, dst_bpp,
+                                     b.x1 + src_dx, b.y1 + src_dy,
+                                     b.x1 + dst_dx, b.y1 + dst_dy, w, h))
+                return i;
+        }
+        i += m;
+    }
+    if (n > 0 && (done = fb_copyarea_submit(ctx, areas, tune_slots, n)) < n)
+        return first_box[done];
+    return nboxes;
 }
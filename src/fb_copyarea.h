@@ -25,6 +25,8 @@
 #define FB_COPYAREA_H
 
 #include "interfaces.h"
+#include "blt_tuner.h"
+#include "submit_queue.h"
 
 typedef struct {
     /* framebuffer descriptor */
@@ -45,11 +47,37 @@ typedef struct {
     /* Optional fallback interface to handle unsupported operations */
     blt2d_i            *fallback_blt2d;
     int                 do_copyarea;
+    /* The kernel can do a whole array of copies with a single ioctl */
+    int                 do_copyarea_multi;
+    /* The kernel provides accelerated solid fills */
+    int                 do_fillrect;
+    /* Not NULL if the ioctls are done from a separate thread */
+    submit_queue_t     *queue;
+    /* Not NULL if the blit size threshold is learned at runtime */
+    blt_tuner_t        *tuner;
 } fb_copyarea_t;
 
 fb_copyarea_t *fb_copyarea_init(const char *fb_device, void *xserver_fbmem);
 void fb_copyarea_close(fb_copyarea_t *fb_copyarea);
 
+/*
+ * Measure the time of FBIOCOPYAREA and FBIOFILLRECT ioctls and their CPU
+ * fallbacks and adjust the size thresholds, starting from which the ioctls
+ * are used, for each width. Returns 0 on success.
+ */
+int fb_copyarea_enable_tuning(fb_copyarea_t *fb_copyarea);
+
+/*
+ * Do the ioctls from a separate thread, so that the X server does not have
+ * to wait for them. Sets blt2d.sync, so it must be called before the blt2d
+ * pointers are picked up by the user. Needs to be called after
+ * fb_copyarea_enable_tuning. Returns 0 on success.
+ */
+int fb_copyarea_enable_async(fb_copyarea_t *fb_copyarea);
+
+/* Wait until the queued copies are finished (blt2d_i::sync) */
+void fb_copyarea_sync(void *self);
+
 int fb_copyarea_blt(void               *self,
                     uint32_t           *src_bits,
                     uint32_t           *dst_bits,
@@ -64,4 +92,30 @@ int fb_copyarea_blt(void               *self,
                     int                 w,
                     int                 h);
 
+/* Solid fill using the FBIOFILLRECT ioctl if the kernel supports it */
+int fb_copyarea_fill(void               *self,
+                     uint32_t           *bits,
+                     int                 stride,
+                     int                 bpp,
+                     int                 x,
+                     int                 y,
+                     int                 w,
+                     int                 h,
+                     uint32_t            filler);
+
+/* Batched fb_copyarea_blt (see blt_boxes in blt2d_i) */
+int fb_copyarea_blt_boxes(void               *self,
+                          uint32_t           *src_bits,
+                          uint32_t           *dst_bits,
+                          int                 src_stride,
+                          int                 dst_stride,
+                          int                 src_bpp,
+                          int                 dst_bpp,
+                          const blt2d_box_t  *boxes,
+                          int                 nboxes,
+                          int                 src_dx,
+                          int                 src_dy,
+                          int                 dst_dx,
+                          int                 dst_dy);
+
 #endif
@@ -59,6 +59,7 @@
 #include "xf86RandR12.h"
 
 #include "cpu_backend.h"
+#include "flush_pacer.h"
 #include "fb_copyarea.h"
 
 #include "sunxi_disp.h"
@@ -208,6 +209,9 @@ static SymTabRec FBDevChipsets[] = {
 typedef enum {
 	OPTION_SHADOW_FB,
 	OPTION_ROTATE,
+	OPTION_SHADOW_FB_SYNC,
+	OPTION_SHADOW_FB_LOW_LATENCY,
+	OPTION_SHADOW_FB_DEPTH24,
 	OPTION_FBDEV,
 	OPTION_DEBUG,
 	OPTION_HW_CURSOR,
@@ -216,15 +220,26 @@ typedef enum {
 	OPTION_DRI2_OVERLAY,
 	OPTION_SWAPBUFFERS_WAIT,
 	OPTION_ACCELMETHOD,
+	OPTION_G2D_ASYNC,
+	OPTION_G2D_OFFSCREEN_PIXMAPS,
+	OPTION_ACCEL_AUTO_TUNE,
+	OPTION_G2D_HYBRID_BLT,
+	OPTION_COPYAREA_ASYNC,
 	OPTION_USE_BS,
 	OPTION_FORCE_BS,
 	OPTION_XV_OVERLAY,
 	OPTION_USE_DUMB,
+	OPTION_CPU_BLT_CALIBRATE,
+	OPTION_CPU_BLT_CACHE,
+	OPTION_CONVERSION_DITHER,
 } FBDevOpts;
 
 static const OptionInfoRec FBDevOptions[] = {
 	{ OPTION_SHADOW_FB,	"ShadowFB",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_ROTATE,	"Rotate",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_SHADOW_FB_SYNC,"ShadowFBSync",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_SHADOW_FB_LOW_LATENCY,"ShadowFBLowLatency",OPTV_BOOLEAN,{0},FALSE },
+	{ OPTION_SHADOW_FB_DEPTH24,"ShadowFBDepth24",OPTV_BOOLEAN,{0},	FALSE },
 	{ OPTION_FBDEV,		"fbdev",	OPTV_STRING,	{0},	FALSE },
 	{ OPTION_DEBUG,		"debug",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_HW_CURSOR,	"HWCursor",	OPTV_BOOLEAN,	{0},	FALSE },
@@ -233,10 +248,18 @@ static const OptionInfoRec FBDevOptions[] = {
 	{ OPTION_DRI2_OVERLAY,	"DRI2HWOverlay",OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_SWAPBUFFERS_WAIT,"SwapbuffersWait",OPTV_BOOLEAN,{0},	FALSE },
 	{ OPTION_ACCELMETHOD,	"AccelMethod",	OPTV_STRING,	{0},	FALSE },
+	{ OPTION_G2D_ASYNC,	"G2DAsync",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_G2D_OFFSCREEN_PIXMAPS,"G2DOffscreenPixmaps",OPTV_BOOLEAN,{0},FALSE },
+	{ OPTION_ACCEL_AUTO_TUNE,"AccelAutoTune",OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_G2D_HYBRID_BLT,"G2DHybridBlt",	OPTV_BOOLEAN,	{0},	FALSE },
+	{ OPTION_COPYAREA_ASYNC,"CopyAreaAsync",OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_USE_BS,	"UseBackingStore",OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_FORCE_BS,	"ForceBackingStore",OPTV_BOOLEAN,{0},	FALSE },
 	{ OPTION_XV_OVERLAY,	"XVHWOverlay",	OPTV_BOOLEAN,	{0},	FALSE },
 	{ OPTION_USE_DUMB,      "UseDumb",	OPTV_BOOLEAN,   {0},    FALSE },
+	{ OPTION_CPU_BLT_CALIBRATE,"CPUBltCalibrate",OPTV_BOOLEAN,{0},	FALSE },
+	{ OPTION_CPU_BLT_CACHE,	"CPUBltCalibrationCache",OPTV_STRING,{0},FALSE },
+	{ OPTION_CONVERSION_DITHER,"ConversionDither",OPTV_BOOLEAN,{0},	FALSE },
 	{ -1,			NULL,		OPTV_NONE,	{0},	FALSE }
 };
 
@@ -443,7 +466,9 @@ static Bool FBTurboHWModeInit(ScrnInfoPtr pScrn, DisplayModePtr mode)
                 return FALSE;
         }
 
-        if (pScrn->defaultVisual == TrueColor || pScrn->defaultVisual == DirectColor)
+        /* The shadow framebuffer may be in a different format (ShadowFBDepth24) */
+        if ((pScrn->defaultVisual == TrueColor || pScrn->defaultVisual == DirectColor) &&
+            pScrn->bitsPerPixel == fPtr->scanoutBpp)
         {
                 pScrn->offset.red   = fPtr->fb_lcd_var.red.offset;
                 pScrn->offset.green = fPtr->fb_lcd_var.green.offset;
@@ -966,10 +991,14 @@ static void
 FBTurboLeaveVT(VT_FUNC_ARGS_DECL)
 {
 	SCRN_INFO_PTR(arg);
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
 	int i, ret;
 
 	TRACE_ENTER();
 
+	/* the console must not be overwritten by the queued G2D/ioctl blits */
+	SunxiG2D_Sync(fPtr->SunxiG2D_private);
+
 	for (i = 1; i < currentMaxClients; i++) {
 		if (clients[i] && !clients[i]->clientGone)
 			IgnoreClient(clients[i]);
@@ -1458,6 +1487,7 @@ FBDevPreInit(ScrnInfoPtr pScrn, int flags)
 	const char *s;
 	int type;
 	cpuinfo_t *cpuinfo;
+	Bool shadow_depth24 = FALSE;
 
 	if (flags & PROBE_DETECT) return FALSE;
 
@@ -1508,12 +1538,34 @@ FBDevPreInit(ScrnInfoPtr pScrn, int flags)
 
 	default_depth = FBTurboHWGetDepth(pScrn,&fbbpp);
 
+	/*
+	 * Optionally run a depth 24 screen in a 32bpp shadow framebuffer on
+	 * top of a 16bpp framebuffer, converting the damaged areas on update.
+	 * The options are not processed yet, so check them directly.
+	 */
+	if (fPtr->isFBDevHW && fbbpp == 16 &&
+	    xf86CheckBoolOption(fPtr->pEnt->device->options, "ShadowFBDepth24",
+	                        FALSE)) {
+		if (xf86FindOptionValue(fPtr->pEnt->device->options, "Rotate")) {
+			INFO_MSG("ShadowFBDepth24 can't be used together with Rotate");
+		}
+		else {
+			default_depth = 24;
+			fbbpp = 32;
+			shadow_depth24 = TRUE;
+		}
+	}
+
 	INFO_MSG( "xf86SetDepthBpp(pScrn, %d, %d, %d, ...)", default_depth, default_depth, fbbpp);
 	if (!xf86SetDepthBpp(pScrn, default_depth, default_depth, fbbpp,
 			     Support24bppFb | Support32bppFb | SupportConvert32to24 | SupportConvert24to32))
 		return FALSE;
 	xf86PrintDepthBpp(pScrn);
 
+	fPtr->scanoutBpp = pScrn->bitsPerPixel;
+	if (shadow_depth24 && pScrn->bitsPerPixel == 32)
+		fPtr->scanoutBpp = 16;
+
 	/* Get the depth24 pixmap format */
 	if (pScrn->depth == 24 && pix24bpp == 0)
 		pix24bpp = xf86GetBppFromDepth(pScrn, 24);
@@ -1583,6 +1635,13 @@ FBDevPreInit(ScrnInfoPtr pScrn, int flags)
 	fPtr->shadowFB = xf86ReturnOptValBool(fPtr->Options, OPTION_SHADOW_FB,
 					      fPtr->shadowFB);
 
+	/* the conversion to the framebuffer format is done by the shadow layer */
+	if (pScrn->bitsPerPixel != fPtr->scanoutBpp) {
+		fPtr->shadowFB = TRUE;
+		CONFIG_MSG("using depth %d shadow framebuffer with %dbpp scanout",
+		           pScrn->depth, fPtr->scanoutBpp);
+	}
+
 	debug = xf86ReturnOptValBool(fPtr->Options, OPTION_DEBUG, FALSE);
 
 	fPtr->NoFlip = FALSE;
@@ -1777,20 +1836,155 @@ FBDevPreInit(ScrnInfoPtr pScrn, int flags)
 }
 
 
-#if ABI_VIDEODRV_VERSION >= SET_ABI_VERSION(24, 0)
+/*
+ * Copy the damaged parts of the shadow framebuffer to the real one, doing
+ * the rotation with the tiled cpu_backend code (the generic rotation code
+ * from the shadow module processes one pixel at a time and is very slow).
+ * Returns FALSE if this is not supported.
+ */
+static Bool
+FBDevUpdateRotated(ScreenPtr pScreen, RegionPtr damage)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	cpu_backend_t *cpu_backend = fPtr->cpu_backend_private;
+	PixmapPtr pShadow = pScreen->GetScreenPixmap(pScreen);
+	BoxPtr pbox = RegionRects(damage);
+	int nbox = RegionNumRects(damage);
+	FbBits *shaBase;
+	FbStride shaStride;
+	int shaBpp;
+	_X_UNUSED int shaXoff, shaYoff;
+	CARD32 winSize;
+	uint32_t *win;
+
+	fbGetDrawable(&pShadow->drawable, shaBase, shaStride, shaBpp,
+		      shaXoff, shaYoff);
+	if (!cpu_backend || (shaBpp != 16 && shaBpp != 32))
+		return FALSE;
+
+	win = FBDevWindowLinear(pScreen, 0, 0, SHADOW_WINDOW_WRITE, &winSize,
+				NULL);
+	if (!win)
+		return TRUE;
+
+	while (nbox--) {
+		cpu_backend_rotated_blt(cpu_backend, (uint32_t *)shaBase, win,
+					shaStride, winSize / 4, shaBpp, fPtr->rotate,
+					pShadow->drawable.width,
+					pShadow->drawable.height,
+					pbox->x1, pbox->y1,
+					pbox->x2 - pbox->x1, pbox->y2 - pbox->y1);
+		pbox++;
+	}
+	return TRUE;
+}
+
+/*
+ * Copy the damaged parts of the shadow framebuffer to the real one using
+ * cpu_backend, which merges the damaged boxes into larger rectangles and
+ * splits the large ones between the worker threads. This is synchronous,
+ * so the BlockHandler does not return before the copy is finished.
+ * Returns FALSE if this is not supported.
+ */
+static Bool
+FBDevUpdateBands(ScreenPtr pScreen, RegionPtr damage)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	cpu_backend_t *cpu_backend = fPtr->cpu_backend_private;
+	PixmapPtr pShadow = pScreen->GetScreenPixmap(pScreen);
+	FbBits *shaBase;
+	FbStride shaStride;
+	int shaBpp;
+	_X_UNUSED int shaXoff, shaYoff;
+	CARD32 winSize;
+	uint32_t *win;
+
+	if (!cpu_backend)
+		return FALSE;
+
+	fbGetDrawable(&pShadow->drawable, shaBase, shaStride, shaBpp,
+		      shaXoff, shaYoff);
+	win = FBDevWindowLinear(pScreen, 0, 0, SHADOW_WINDOW_WRITE, &winSize,
+				NULL);
+	if (!win)
+		return TRUE;
+
+	return cpu_backend_shadow_update(cpu_backend, (uint32_t *)shaBase, win,
+				shaStride, winSize / 4, shaBpp, fPtr->scanoutBpp,
+				(const blt2d_box_t *)RegionRects(damage),
+				RegionNumRects(damage));
+}
+
+/*
+ * Copy the accumulated damage to the real framebuffer if the flush pacer
+ * allows this. Returns 0 if done (or if there was nothing to do), otherwise
+ * the number of milliseconds to wait before trying again.
+ */
+static int
+FBDevFlushPending(ScreenPtr pScreen)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	int delay;
+
+	if (!RegionNotEmpty(&fPtr->shadowPending))
+		return 0;
+	if ((delay = flush_pacer_get_delay(fPtr->flush_pacer_private)) > 0)
+		return delay;
+
+	SunxiG2D_Sync(fPtr->SunxiG2D_private);
+	if (fPtr->rotate)
+		FBDevUpdateRotated(pScreen, &fPtr->shadowPending);
+	else
+		FBDevUpdateBands(pScreen, &fPtr->shadowPending);
+
+	flush_pacer_flushed(fPtr->flush_pacer_private);
+	RegionEmpty(&fPtr->shadowPending);
+	return 0;
+}
+
 static void
 FBDevUpdatePacked(ScreenPtr pScreen, shadowBufPtr pBuf)
 {
 	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
 	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	RegionPtr damage = DamageRegion(pBuf->pDamage);
+
+	/*
+	 * The shadow module empties its damage region after this call, so
+	 * keep the damage which can't be flushed yet in our own region
+	 * (the pacer is only enabled when the helpers below can handle it).
+	 */
+	if (fPtr->flush_pacer_private) {
+		RegionUnion(&fPtr->shadowPending, &fPtr->shadowPending, damage);
+		FBDevFlushPending(pScreen);
+		return;
+	}
+
+	SunxiG2D_Sync(fPtr->SunxiG2D_private);
+	if (fPtr->rotate && FBDevUpdateRotated(pScreen, damage))
+		return;
+	if (!fPtr->rotate && FBDevUpdateBands(pScreen, damage))
+		return;
+
+	/* The generic code from the shadow module can't convert formats */
+	if (pScrn->bitsPerPixel != fPtr->scanoutBpp)
+		return;
 
+#if ABI_VIDEODRV_VERSION >= SET_ABI_VERSION(24, 0)
 	if (fPtr->rotate)
 		shadowUpdateRotatePacked(pScreen, pBuf);
 	else
 		shadowUpdatePacked(pScreen, pBuf);
-
-}
+#else
+	if (fPtr->rotate)
+		shadowUpdateRotatePackedWeak()(pScreen, pBuf);
+	else
+		shadowUpdatePackedWeak()(pScreen, pBuf);
 #endif
+}
 
 static Bool
 FBDevCreateScreenResources(ScreenPtr pScreen)
@@ -1819,12 +2013,7 @@ FBDevCreateScreenResources(ScreenPtr pScreen)
         FatalError("Couldn't adjust screen pixmap\n");
 
     if(fPtr->shadowFB) {
-#if ABI_VIDEODRV_VERSION >= SET_ABI_VERSION(24, 0)
 	if (!shadowAdd(pScreen, pPixmap, FBDevUpdatePacked,
-#else
-	if (!shadowAdd(pScreen, pPixmap, fPtr->rotate ?
-		   shadowUpdateRotatePackedWeak() : shadowUpdatePackedWeak(),
-#endif
 		   FBDevWindowLinear, fPtr->rotate, NULL)) {
 		return FALSE;
 	}
@@ -1843,6 +2032,39 @@ FBDevShadowInit(ScreenPtr pScreen)
     return TRUE;
 }
 
+/*
+ * Put the backing pixmaps into the spare framebuffer memory, but leave
+ * enough of it for the double buffered DRI2 windows and XV overlays
+ * (the same amount, which is recommended by FBTurboMaliDRI2_Init).
+ */
+static void
+FBDevInitOffscreenPixmaps(ScreenPtr pScreen, sunxi_disp_t *disp)
+{
+	ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	uint32_t reserved = disp->gfx_layer_size + disp->xres * disp->yres * 4 * 2;
+
+	reserved = (reserved + 4095) & ~4095;
+
+	if (fPtr->shadowFB) {
+		INFO_MSG("offscreen pixmaps are not useful with ShadowFB");
+		return;
+	}
+	if (disp->framebuffer_size < reserved + 1024 * 1024) {
+		INFO_MSG("not enough framebuffer memory for offscreen pixmaps");
+		return;
+	}
+	if (!SunxiG2D_InitOffscreenPixmaps(pScreen,
+	                                   disp->framebuffer_addr + reserved,
+	                                   disp->framebuffer_size - reserved)) {
+		INFO_MSG("failed to enable offscreen pixmaps");
+		return;
+	}
+	disp->overlay_area_end = reserved;
+	INFO_MSG("using %d KiB of framebuffer memory for offscreen pixmaps",
+	         (int)(disp->framebuffer_size - reserved) / 1024);
+}
+
 static void
 fbdev_load_palette(ScrnInfoPtr pScrn, int numColors,
                      int *indices, LOCO * colors, VisualPtr pVisual)
@@ -1920,6 +2142,7 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	int type;
 	int depth;
 	const char *accelmethod;
+	const char *shadow_sync;
 	cpu_backend_t *cpu_backend;
 	Bool useBackingStore = FALSE, forceBackingStore = FALSE;
 
@@ -2181,7 +2404,7 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	 */
 	useBackingStore = xf86ReturnOptValBool(fPtr->Options, OPTION_USE_BS,
 	                                       !fPtr->shadowFB && !fPtr->UseEXA);
-#ifndef __arm__
+#if !defined(__arm__) && !defined(__aarch64__)
 	/*
 	 * right now we can only make "smart" decisions on ARM hardware,
 	 * everything else (for example x86) would take a performance hit
@@ -2201,6 +2424,55 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	/* initialize the 'CPU' backend */
 	cpu_backend = cpu_backend_init(fPtr->fbmem, pScrn->videoRam);
 	fPtr->cpu_backend_private = cpu_backend;
+	if (cpu_backend)
+		cpu_backend->dither_32_to_16 = xf86ReturnOptValBool(fPtr->Options,
+		                                   OPTION_CONVERSION_DITHER, FALSE);
+
+	if (cpu_backend && fPtr->fbmem &&
+	    xf86ReturnOptValBool(fPtr->Options, OPTION_CPU_BLT_CALIBRATE, TRUE)) {
+		int res = cpu_backend_calibrate(cpu_backend,
+		              xf86GetOptValString(fPtr->Options, OPTION_CPU_BLT_CACHE));
+		if (res >= 0) {
+			INFO_MSG( "%s CPU blt kernels: %s (small), %s (medium), %s (large)",
+			          res > 0 ? "cached" : "calibrated",
+			          cpu_backend->size_class_name[0],
+			          cpu_backend->size_class_name[1],
+			          cpu_backend->size_class_name[2]);
+		}
+		else {
+			INFO_MSG( "CPU blt kernels calibration is not possible");
+		}
+	}
+
+	if (fPtr->shadowFB && cpu_backend &&
+	    (shadow_sync = xf86GetOptValString(fPtr->Options,
+	                                       OPTION_SHADOW_FB_SYNC)) &&
+	    strcasecmp(shadow_sync, "none") != 0) {
+		double vrefresh = pScrn->currentMode ?
+		                  xf86ModeVRefresh(pScrn->currentMode) : 0;
+		Bool use_vsync = strcasecmp(shadow_sync, "vsync") == 0;
+		if (vrefresh <= 0)
+			vrefresh = 60;
+		if (!use_vsync && strcasecmp(shadow_sync, "timer") != 0)
+			WARNING_MSG("unknown ShadowFBSync value '%s', using 'timer'",
+			            shadow_sync);
+		if (fPtr->rotate ? (pScrn->bitsPerPixel != 16 &&
+		                    pScrn->bitsPerPixel != 32) :
+		                   (pScrn->bitsPerPixel % 8) != 0) {
+			INFO_MSG("ShadowFBSync is not supported at %dbpp",
+			         pScrn->bitsPerPixel);
+		}
+		else if ((fPtr->flush_pacer_private = flush_pacer_init(
+		                  xf86FindOptionValue(fPtr->pEnt->device->options,
+		                                      "fbdev"),
+		                  use_vsync, vrefresh,
+		                  xf86ReturnOptValBool(fPtr->Options,
+		                              OPTION_SHADOW_FB_LOW_LATENCY, TRUE)))) {
+			RegionNull(&fPtr->shadowPending);
+			INFO_MSG("ShadowFB updates are paced by %s at %.1f Hz",
+			         use_vsync ? "vsync" : "timer", vrefresh);
+		}
+	}
 
 	/* try to load G2D kernel module before initializing sunxi-disp */
 	if (!xf86LoadKernelModule("g2d_23"))
@@ -2221,10 +2493,30 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	if (!(accelmethod = xf86GetOptValString(fPtr->Options, OPTION_ACCELMETHOD)) ||
 						strcasecmp(accelmethod, "g2d") == 0) {
 		sunxi_disp_t *disp = fPtr->sunxi_disp_private;
+		/* the tuner must be there before the G2D thread is started */
+		if (disp && disp->fd_g2d >= 0 &&
+		    xf86ReturnOptValBool(fPtr->Options, OPTION_ACCEL_AUTO_TUNE, TRUE) &&
+		    sunxi_g2d_enable_tuning(disp) == 0) {
+			INFO_MSG( "G2D blit size thresholds are tuned at runtime");
+		}
+		/* must be done before SunxiG2D_Init picks up blt2d.sync */
+		if (disp && disp->fd_g2d >= 0 &&
+		    xf86ReturnOptValBool(fPtr->Options, OPTION_G2D_ASYNC, TRUE) &&
+		    sunxi_g2d_enable_async(disp) == 0) {
+			INFO_MSG( "G2D operations are submitted asynchronously");
+			if (xf86ReturnOptValBool(fPtr->Options,
+			                         OPTION_G2D_HYBRID_BLT, FALSE) &&
+			    sunxi_g2d_enable_hybrid(disp) == 0) {
+				INFO_MSG( "large blits are split between G2D and the CPU");
+			}
+		}
 		if (disp && disp->fd_g2d >= 0 &&
 		    (fPtr->SunxiG2D_private = SunxiG2D_Init(pScreen, &disp->blt2d))) {
 			disp->fallback_blt2d = &cpu_backend->blt2d;
 			INFO_MSG( "enabled G2D acceleration");
+			if (xf86ReturnOptValBool(fPtr->Options,
+			                         OPTION_G2D_OFFSCREEN_PIXMAPS, FALSE))
+				FBDevInitOffscreenPixmaps(pScreen, disp);
 		}
 		else {
 			INFO_MSG(
@@ -2242,6 +2534,28 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 		if (!(accelmethod = xf86GetOptValString(fPtr->Options, OPTION_ACCELMETHOD)) ||
 						strcasecmp(accelmethod, "copyarea") == 0) {
 			fb_copyarea_t *fb = fPtr->fb_copyarea_private;
+			/* the tuner must be there before the copyarea thread is started */
+			if (xf86ReturnOptValBool(fPtr->Options,
+			                         OPTION_ACCEL_AUTO_TUNE, TRUE) &&
+			    fb_copyarea_enable_tuning(fb) == 0) {
+				INFO_MSG(
+				   "copyarea blit size thresholds are tuned at runtime");
+			}
+			if (fb->do_copyarea_multi) {
+				INFO_MSG(
+				   "the kernel supports batched copyarea ioctls");
+			}
+			if (fb->do_fillrect) {
+				INFO_MSG(
+				   "the kernel supports accelerated fillrect ioctls");
+			}
+			/* must be done before SunxiG2D_Init picks up blt2d.sync */
+			if (xf86ReturnOptValBool(fPtr->Options,
+			                         OPTION_COPYAREA_ASYNC, TRUE) &&
+			    fb_copyarea_enable_async(fb) == 0) {
+				INFO_MSG(
+				   "copyarea ioctls are submitted asynchronously");
+			}
 			if ((fPtr->SunxiG2D_private = SunxiG2D_Init(pScreen, &fb->blt2d))) {
 				fb->fallback_blt2d = &cpu_backend->blt2d;
 				INFO_MSG(
@@ -2258,9 +2572,9 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 		}
 	}
 
-	if (!fPtr->SunxiG2D_private && fPtr->fbmem && cpu_backend->cpuinfo->has_arm_vfp) {
+	if (!fPtr->SunxiG2D_private && fPtr->fbmem) {
 		if ((fPtr->SunxiG2D_private = SunxiG2D_Init(pScreen, &cpu_backend->blt2d))) {
-			INFO_MSG( "enabled VFP/NEON optimizations");
+			INFO_MSG( "enabled %s optimizations", cpu_backend->blt2d_name);
 		}
 	}
 
@@ -2273,7 +2587,9 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	fPtr->CreateScreenResources = pScreen->CreateScreenResources;
 	pScreen->CreateScreenResources = FBDevCreateScreenResources;
 
-	if (!fPtr->rotate)
+	if (pScrn->bitsPerPixel != fPtr->scanoutBpp)
+	  INFO_MSG( "shadow framebuffer format conversion; disabling DGA");
+	else if (!fPtr->rotate)
 	  FBDevDGAInit(pScrn, pScreen);
 	else {
 	  INFO_MSG( "display rotated; disabling DGA");
@@ -2446,6 +2762,25 @@ FBDevScreenInit(SCREEN_INIT_ARGS_DECL)
 	return TRUE;
 }
 
+/* Log the blit size thresholds learned by the accelerated backends */
+static void
+FBDevReportTuning(ScrnInfoPtr pScrn)
+{
+	FBDevPtr fPtr = FBDEVPTR(pScrn);
+	sunxi_disp_t *disp = fPtr->sunxi_disp_private;
+	fb_copyarea_t *fb = fPtr->fb_copyarea_private;
+	char buf[256];
+
+	if (disp && disp->tuner) {
+		blt_tuner_report(disp->tuner, buf, sizeof(buf));
+		INFO_MSG("G2D blit thresholds (pixels): %s", buf);
+	}
+	if (fb && fb->tuner) {
+		blt_tuner_report(fb->tuner, buf, sizeof(buf));
+		INFO_MSG("copyarea blit thresholds (pixels): %s", buf);
+	}
+}
+
 static Bool
 FBDevCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 {
@@ -2476,11 +2811,20 @@ FBDevCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 		if (fPtr->FBTurboEXA_private->CloseScreen)
 			fPtr->FBTurboEXA_private->CloseScreen(CLOSE_SCREEN_ARGS);
 
+	/* let the queued blits finish before the framebuffer goes away */
+	SunxiG2D_Sync(fPtr->SunxiG2D_private);
+
 	if (fPtr->isFBDevHW) {
 		fbdevHWRestore(pScrn);
 		FBTurboHWUnmapVidmem(pScrn);
 	}
 
+	if (fPtr->flush_pacer_private) {
+	    flush_pacer_close(fPtr->flush_pacer_private);
+	    fPtr->flush_pacer_private = NULL;
+	    RegionUninit(&fPtr->shadowPending);
+	}
+
 	if (fPtr->shadow) {
 	    shadowRemove(pScreen, pScreen->GetScreenPixmap(pScreen));
 	    if (fPtr->shadow != fPtr->scanout_ptr)
@@ -2499,6 +2843,7 @@ FBDevCloseScreen(CLOSE_SCREEN_ARGS_DECL)
 	    free(fPtr->SunxiG2D_private);
 	    fPtr->SunxiG2D_private = NULL;
 	}
+	FBDevReportTuning(pScrn);
 	if (fPtr->fb_copyarea_private) {
 	    fb_copyarea_close(fPtr->fb_copyarea_private);
 	    fPtr->fb_copyarea_private = NULL;
@@ -2573,6 +2918,13 @@ FBDevBlockHandler(BLOCKHANDLER_ARGS_DECL)
 	swap(fPtr, pScreen, BlockHandler);
 	(*pScreen->BlockHandler) (BLOCKHANDLER_ARGS);
 	swap(fPtr, pScreen, BlockHandler);
+
+	/* Wake up in time to flush the ShadowFB damage held back by the pacer */
+	if (fPtr->flush_pacer_private) {
+		int delay = FBDevFlushPending(pScreen);
+		if (delay > 0)
+			AdjustWaitForDelay(pTimeout, delay);
+	}
 }
 
 static void
@@ -60,6 +60,9 @@ typedef struct {
 	int				rotate;
 	Bool				shadowFB;
 	void				*shadow;
+	/* The bpp of the framebuffer, may differ from the X screen only if
+	   the 32bpp shadow framebuffer is converted to 16bpp on updates */
+	int				scanoutBpp;
 	CloseScreenProcPtr		CloseScreen;
 	CreateScreenResourcesProcPtr	CreateScreenResources;
 	ScreenBlockHandlerProcPtr	BlockHandler;
@@ -71,6 +74,8 @@ typedef struct {
 	OptionInfoPtr			Options;
 
 	void				*cpu_backend_private;
+	void				*flush_pacer_private;
+	RegionRec			shadowPending;
 	void				*backing_store_tuner_private;
 	void				*sunxi_disp_private;
 	void				*fb_copyarea_private;
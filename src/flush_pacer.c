@@ -0,0 +1,244 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+
+#include "flush_pacer.h"
+#include "worker_pool.h"
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC _IOW('F', 0x20, uint32_t)
+#endif
+
+struct flush_pacer_t {
+    /* The refresh period in microseconds */
+    int64_t           period_us;
+    int               low_latency;
+    int64_t           last_flush_us;
+    /* The vsync thread (if fd_fb is not negative) */
+    int               fd_fb;
+    pthread_t         vsync_thread;
+    pthread_mutex_t   lock;
+    pthread_cond_t    cond;
+    /* These are protected by the lock */
+    int               shutdown;
+    int               vsync_failed;
+    int64_t           last_vblank_us;
+    int               waiting;       /* the thread is waiting for vblanks */
+    int               requested;     /* an update is pending */
+    int               thread_done;
+    int               orphaned;      /* the thread has to free the pacer */
+};
+
+/* How long flush_pacer_close waits for the vsync thread to notice it */
+#define CLOSE_TIMEOUT_US 200000
+
+static int64_t
+gettime_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+free_pacer(flush_pacer_t *pacer)
+{
+    if (pacer->fd_fb >= 0)
+        close(pacer->fd_fb);
+    pthread_cond_destroy(&pacer->cond);
+    pthread_mutex_destroy(&pacer->lock);
+    free(pacer);
+}
+
+/*
+ * Only waits for vblank while the updates are pending, so that the idle
+ * X server does not wake up on every refresh and the thread can be stopped
+ * without waiting for a vblank (which may never come for a blanked display).
+ */
+static void *
+vsync_thread(void *arg)
+{
+    flush_pacer_t *pacer = (flush_pacer_t *)arg;
+    int orphaned;
+
+    pthread_mutex_lock(&pacer->lock);
+    while (!pacer->shutdown && !pacer->vsync_failed) {
+        uint32_t crtc = 0;
+        int failed;
+
+        if (!pacer->waiting) {
+            pthread_cond_wait(&pacer->cond, &pacer->lock);
+            continue;
+        }
+        pacer->requested = 0;
+        pthread_mutex_unlock(&pacer->lock);
+
+        failed = ioctl(pacer->fd_fb, FBIO_WAITFORVSYNC, &crtc) != 0;
+
+        pthread_mutex_lock(&pacer->lock);
+        if (failed)
+            pacer->vsync_failed = 1;
+        else
+            pacer->last_vblank_us = gettime_us();
+        /* nobody asked for an update since the previous vblank */
+        if (!pacer->requested)
+            pacer->waiting = 0;
+    }
+    pacer->thread_done = 1;
+    orphaned = pacer->orphaned;
+    pthread_cond_broadcast(&pacer->cond);
+    pthread_mutex_unlock(&pacer->lock);
+
+    if (orphaned)
+        free_pacer(pacer);
+    return NULL;
+}
+
+flush_pacer_t *flush_pacer_init(const char *device, int use_vsync,
+                                double vrefresh, int low_latency)
+{
+    flush_pacer_t *pacer = calloc(sizeof(flush_pacer_t), 1);
+    pthread_condattr_t cond_attr;
+    int fd_fb = -1;
+    if (!pacer)
+        return NULL;
+
+    if (vrefresh < 1)
+        vrefresh = 60;
+    pacer->period_us   = (int64_t)(1000000 / vrefresh);
+    pacer->low_latency = low_latency;
+    pacer->fd_fb       = -1;
+    pthread_mutex_init(&pacer->lock, NULL);
+    /* the timed wait in flush_pacer_close uses CLOCK_MONOTONIC */
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pacer->cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    /* use /dev/fb0 by default */
+    if (!device)
+        device = "/dev/fb0";
+
+    if (use_vsync)
+        fd_fb = open(device, O_RDWR);
+
+    if (fd_fb >= 0) {
+        /* The thread only uses fd_fb after being woken up by get_delay */
+        pacer->fd_fb = fd_fb;
+        if (fbturbo_thread_create(&pacer->vsync_thread,
+                                  vsync_thread, pacer) != 0) {
+            pacer->fd_fb = -1;
+            close(fd_fb);
+        }
+    }
+
+    return pacer;
+}
+
+void flush_pacer_close(flush_pacer_t *pacer)
+{
+    int64_t deadline_us = gettime_us() + CLOSE_TIMEOUT_US;
+    struct timespec deadline;
+    int done = 1;
+
+    if (pacer->fd_fb >= 0) {
+        deadline.tv_sec  = deadline_us / 1000000;
+        deadline.tv_nsec = (deadline_us % 1000000) * 1000;
+        pthread_mutex_lock(&pacer->lock);
+        pacer->shutdown = 1;
+        pthread_cond_broadcast(&pacer->cond);
+        while (!pacer->thread_done &&
+               pthread_cond_timedwait(&pacer->cond, &pacer->lock,
+                                      &deadline) == 0);
+        done = pacer->thread_done;
+        /* Still stuck in the ioctl, let it clean up after itself */
+        if (!done)
+            pacer->orphaned = 1;
+        pthread_mutex_unlock(&pacer->lock);
+        if (done)
+            pthread_join(pacer->vsync_thread, NULL);
+        else
+            pthread_detach(pacer->vsync_thread);
+    }
+    if (done)
+        free_pacer(pacer);
+}
+
+int flush_pacer_get_delay(flush_pacer_t *pacer)
+{
+    int64_t now = gettime_us();
+    int64_t next_us = pacer->last_flush_us + pacer->period_us;
+    int64_t last_vblank_us = 0;
+    int vsync_failed = 1;
+
+    if (pacer->fd_fb >= 0) {
+        pthread_mutex_lock(&pacer->lock);
+        pacer->requested = 1;
+        if (!pacer->waiting && !pacer->vsync_failed) {
+            /*
+             * The thread has been idle, so there was no update during the
+             * last refresh and it can be done right away, like after a vblank
+             */
+            pacer->waiting = 1;
+            pacer->last_vblank_us = now;
+            pthread_cond_signal(&pacer->cond);
+        }
+        vsync_failed   = pacer->vsync_failed;
+        last_vblank_us = pacer->last_vblank_us;
+        pthread_mutex_unlock(&pacer->lock);
+    }
+
+    /* Nothing has been shown for a while, no need to wait */
+    if (pacer->low_latency && now >= next_us)
+        return 0;
+
+    if (!vsync_failed && last_vblank_us) {
+        /* Update once right after each vblank */
+        if (last_vblank_us > pacer->last_flush_us)
+            return 0;
+        next_us = last_vblank_us + pacer->period_us;
+        /* The vblank is late (the display may be blanked), stop waiting */
+        if (now >= next_us + pacer->period_us)
+            return 0;
+        /* Otherwise wait until the vsync thread notices it */
+        if (now >= next_us)
+            return 1;
+    }
+
+    if (now >= next_us)
+        return 0;
+    return (int)((next_us - now + 999) / 1000);
+}
+
+void flush_pacer_flushed(flush_pacer_t *pacer)
+{
+    pacer->last_flush_us = gettime_us();
+}
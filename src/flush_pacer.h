@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FLUSH_PACER_H
+#define FLUSH_PACER_H
+
+/*
+ * Limits the rate of the shadow framebuffer updates to at most one per
+ * display refresh. The refresh cycle is tracked either by a helper thread
+ * waiting for vertical blanking with the FBIO_WAITFORVSYNC ioctl, or just
+ * by a timer with the refresh period.
+ */
+typedef struct flush_pacer_t flush_pacer_t;
+
+/*
+ * Create a pacer for the display refreshed 'vrefresh' times per second.
+ * With 'use_vsync', the framebuffer 'device' (/dev/fb0 if NULL) is opened
+ * for waiting for vsync (falling back to the timer if this turns out to be
+ * not supported). With 'low_latency', the first update after an idle period
+ * is allowed immediately instead of waiting for the next refresh.
+ */
+flush_pacer_t *flush_pacer_init(const char *device, int use_vsync,
+                                double vrefresh, int low_latency);
+void flush_pacer_close(flush_pacer_t *pacer);
+
+/*
+ * Returns 0 if the update can be done right now, otherwise the number
+ * of milliseconds to wait before checking again.
+ */
+int flush_pacer_get_delay(flush_pacer_t *pacer);
+
+/* Should be called after doing each update */
+void flush_pacer_flushed(flush_pacer_t *pacer);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "uthash.h"
+#include "glyph_cache.h"
+
+typedef struct {
+    const void     *key;
+    glyph_tile_t    tile;
+    uint8_t        *bitmap;        /* the copy of the original bitmap */
+    int             bitmap_stride;
+    int             msb_first;
+    uint32_t        size;          /* the memory used by this entry */
+    UT_hash_handle  hh;
+} glyph_entry_t;
+
+struct glyph_cache_t {
+    glyph_entry_t  *entries;
+    uint32_t        used_bytes;
+    uint32_t        max_bytes;
+};
+
+glyph_cache_t *glyph_cache_init(uint32_t max_bytes)
+{
+    glyph_cache_t *cache = calloc(sizeof(glyph_cache_t), 1);
+    if (!cache)
+        return NULL;
+    cache->max_bytes = max_bytes;
+    return cache;
+}
+
+static void free_entry(glyph_entry_t *entry)
+{
+    free(entry->bitmap);
+    free(entry->tile.a8);
+    free(entry);
+}
+
+static void clear_entries(glyph_cache_t *cache)
+{
+    glyph_entry_t *entry, *tmp;
+    HASH_ITER(hh, cache->entries, entry, tmp) {
+        HASH_DEL(cache->entries, entry);
+        free_entry(entry);
+    }
+    cache->used_bytes = 0;
+}
+
+void glyph_cache_close(glyph_cache_t *cache)
+{
+    clear_entries(cache);
+    free(cache);
+}
+
+static int same_bitmap(const glyph_entry_t *entry,
+                       const uint8_t       *bitmap,
+                       int                  stride,
+                       int                  width,
+                       int                  height,
+                       int                  msb_first)
+{
+    return entry->tile.width == width && entry->tile.height == height &&
+           entry->bitmap_stride == stride && entry->msb_first == msb_first &&
+           memcmp(entry->bitmap, bitmap, stride * height) == 0;
+}
+
+static void expand_bitmap(uint8_t       *a8,
+                          int            a8_stride,
+                          const uint8_t *bitmap,
+                          int            stride,
+                          int            width,
+                          int            height,
+                          int            msb_first)
+{
+    int x, y;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            int bit = msb_first ? 7 - (x & 7) : (x & 7);
+            a8[x] = (bitmap[x >> 3] >> bit) & 1 ? 0xFF : 0;
+        }
+        a8 += a8_stride;
+        bitmap += stride;
+    }
+}
+
+const glyph_tile_t *glyph_cache_get(glyph_cache_t *cache,
+                                    const void    *key,
+                                    const uint8_t *bitmap,
+                                    int            stride,
+                                    int            width,
+                                    int            height,
+                                    int            msb_first)
+{
+    glyph_entry_t *entry;
+    int a8_stride = (width + 3) & ~3;
+    uint32_t size = sizeof(glyph_entry_t) + stride * height +
+                    a8_stride * height;
+
+    if (width <= 0 || height <= 0 || size > cache->max_bytes)
+        return NULL;
+
+    HASH_FIND_PTR(cache->entries, &key, entry);
+    if (entry) {
+        if (same_bitmap(entry, bitmap, stride, width, height, msb_first))
+            return &entry->tile;
+        /* the key has been reused for a different glyph */
+        HASH_DEL(cache->entries, entry);
+        cache->used_bytes -= entry->size;
+        free_entry(entry);
+    }
+
+    if (cache->used_bytes + size > cache->max_bytes)
+        clear_entries(cache);
+
+    entry = calloc(sizeof(glyph_entry_t), 1);
+    if (!entry)
+        return NULL;
+    entry->bitmap = malloc(stride * height);
+    entry->tile.a8 = malloc(a8_stride * height);
+    if (!entry->bitmap || !entry->tile.a8) {
+        free_entry(entry);
+        return NULL;
+    }
+
+    entry->key = key;
+    entry->tile.width = width;
+    entry->tile.height = height;
+    entry->tile.stride = a8_stride;
+    entry->bitmap_stride = stride;
+    entry->msb_first = msb_first;
+    entry->size = size;
+    memcpy(entry->bitmap, bitmap, stride * height);
+    expand_bitmap(entry->tile.a8, a8_stride, bitmap, stride,
+                  width, height, msb_first);
+
+    HASH_ADD_PTR(cache->entries, key, entry);
+    cache->used_bytes += size;
+    return &entry->tile;
+}
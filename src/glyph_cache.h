@@ -0,0 +1,63 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdint.h>
+
+/*
+ * Cache of the 1bpp glyph bitmaps (core fonts) expanded to 8bpp alpha masks,
+ * which can be used by pixman. The glyphs are identified by the 'key'
+ * pointers provided by the caller, but the bitmaps are compared too, so that
+ * the reused keys (after a font is closed) do not return stale tiles. When
+ * the cache grows too big, it is just cleared.
+ */
+typedef struct glyph_cache_t glyph_cache_t;
+
+typedef struct {
+    int      width;
+    int      height;
+    int      stride;   /* bytes per row, a multiple of 4 */
+    uint8_t *a8;       /* 0x00 or 0xFF for each pixel */
+} glyph_tile_t;
+
+/* Create a cache using up to about 'max_bytes' of memory */
+glyph_cache_t *glyph_cache_init(uint32_t max_bytes);
+void glyph_cache_close(glyph_cache_t *cache);
+
+/*
+ * Get the tile for the 'width' x 'height' glyph 'bitmap' with 'stride' bytes
+ * per row. The leftmost pixel of each byte is in the most significant bit if
+ * 'msb_first' is set, otherwise in the least significant bit. The returned
+ * tile is only valid until the next call. Returns NULL on failure.
+ */
+const glyph_tile_t *glyph_cache_get(glyph_cache_t *cache,
+                                    const void    *key,
+                                    const uint8_t *bitmap,
+                                    int            stride,
+                                    int            width,
+                                    int            height,
+                                    int            msb_first);
+
+#endif
@@ -24,6 +24,15 @@
 #ifndef INTERFACES_H
 #define INTERFACES_H
 
+/*
+ * A rectangle with inclusive top left and exclusive bottom right corners.
+ * Has the same layout as BoxRec from the X server, so that the arrays of
+ * boxes from regions can be passed as is.
+ */
+typedef struct {
+    int16_t x1, y1, x2, y2;
+} blt2d_box_t;
+
 /* A simple interface for 2D graphics operations */
 typedef struct {
     void *self; /* The pointer which needs to be passed to functions */
@@ -45,6 +54,111 @@ typedef struct {
                           int       dst_y,
                           int       w,
                           int       h);
+    /*
+     * A counterpart for "pixman_fill" (solid fill of a rectangle with
+     * 'filler' pixel value). Except for the new "self" pointer, the rest
+     * of arguments are exactly the same.
+     */
+    int (*fill)(void     *self,
+                uint32_t *bits,
+                int       stride,
+                int       bpp,
+                int       x,
+                int       y,
+                int       w,
+                int       h,
+                uint32_t  filler);
+    /*
+     * Batched "overlapped_blt" for an array of boxes. Each box is copied
+     * from (x1 + src_dx, y1 + src_dy) to (x1 + dst_dx, y1 + dst_dy). The
+     * boxes are processed in the order, in which they are provided (the
+     * caller is responsible for sorting them according to the overlap
+     * direction), but consecutive boxes may be merged together.
+     *
+     * Returns the number of leading boxes, which have been successfully
+     * processed. The caller needs to handle the next box in some other
+     * way and may retry from the box after it.
+     */
+    int (*blt_boxes)(void              *self,
+                     uint32_t          *src_bits,
+                     uint32_t          *dst_bits,
+                     int                src_stride,
+                     int                dst_stride,
+                     int                src_bpp,
+                     int                dst_bpp,
+                     const blt2d_box_t *boxes,
+                     int                nboxes,
+                     int                src_dx,
+                     int                src_dy,
+                     int                dst_dx,
+                     int                dst_dy);
+    /*
+     * Wait until all the previously started operations are finished. The
+     * implementations, which may return before the hardware is done, need
+     * to provide it. The CPU must call it before accessing the memory,
+     * which might be read or written by such operations. May be NULL if
+     * all operations are synchronous.
+     */
+    void (*sync)(void *self);
+    /*
+     * Scale the src_w x src_h source rectangle to the dst_w x dst_h
+     * destination rectangle, converting between 16bpp and 32bpp if needed.
+     * The filtering is up to the implementation. Returns 0 if the operation
+     * can't be done, in which case nothing is modified. May be NULL.
+     */
+    int (*stretch_blt)(void     *self,
+                       uint32_t *src_bits,
+                       uint32_t *dst_bits,
+                       int       src_stride,
+                       int       dst_stride,
+                       int       src_bpp,
+                       int       dst_bpp,
+                       int       src_x,
+                       int       src_y,
+                       int       src_w,
+                       int       src_h,
+                       int       dst_x,
+                       int       dst_y,
+                       int       dst_w,
+                       int       dst_h);
 } blt2d_i;
 
+/*
+ * Merge the longest possible sequence of consecutive boxes from the start
+ * of the array, which share edges with each other and together form
+ * a rectangle. The result is stored in 'merged' and the number of the
+ * merged boxes is returned.
+ */
+static inline int blt2d_merge_boxes(const blt2d_box_t *boxes,
+                                    int                nboxes,
+                                    blt2d_box_t       *merged)
+{
+    int n = 1;
+    *merged = boxes[0];
+    while (n < nboxes) {
+        const blt2d_box_t *b = &boxes[n];
+        if (b->y1 == merged->y1 && b->y2 == merged->y2 &&
+            (b->x1 == merged->x2 || b->x2 == merged->x1))
+        {
+            if (b->x1 < merged->x1)
+                merged->x1 = b->x1;
+            if (b->x2 > merged->x2)
+                merged->x2 = b->x2;
+        }
+        else if (b->x1 == merged->x1 && b->x2 == merged->x2 &&
+                 (b->y1 == merged->y2 || b->y2 == merged->y1))
+        {
+            if (b->y1 < merged->y1)
+                merged->y1 = b->y1;
+            if (b->y2 > merged->y2)
+                merged->y2 = b->y2;
+        }
+        else {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
 #endif
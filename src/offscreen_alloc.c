@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "offscreen_alloc.h"
+
+/*
+ * The memory is split into blocks, which are kept in a list sorted by
+ * their offsets. The free blocks have no owner and are merged with their
+ * free neighbours. The evicted owners are kept in a separate list.
+ */
+typedef struct block_t {
+    uint32_t        offset;
+    uint32_t        size;
+    void           *owner;
+    uint8_t        *sysmem;     /* only for the evicted owners */
+    uint32_t        last_use;
+    struct block_t *prev;
+    struct block_t *next;
+} block_t;
+
+struct offscreen_alloc_t {
+    uint8_t            *base;
+    uint32_t            size;
+    uint32_t            alignment;
+    offscreen_evict_fn  evict;
+    void               *data;
+    uint32_t            clock;
+    block_t            *blocks;
+    block_t            *evicted;
+};
+
+offscreen_alloc_t *offscreen_alloc_init(uint8_t           *base,
+                                        uint32_t           size,
+                                        uint32_t           alignment,
+                                        offscreen_evict_fn evict,
+                                        void              *data)
+{
+    offscreen_alloc_t *alloc = calloc(sizeof(offscreen_alloc_t), 1);
+    if (!alloc)
+        return NULL;
+
+    alloc->base      = base;
+    alloc->alignment = alignment;
+    alloc->size      = size & ~(alignment - 1);
+    alloc->evict     = evict;
+    alloc->data      = data;
+
+    alloc->blocks = calloc(sizeof(block_t), 1);
+    if (!alloc->blocks || alloc->size == 0) {
+        free(alloc->blocks);
+        free(alloc);
+        return NULL;
+    }
+    alloc->blocks->size = alloc->size;
+    return alloc;
+}
+
+void offscreen_alloc_close(offscreen_alloc_t *alloc)
+{
+    while (alloc->blocks) {
+        block_t *next = alloc->blocks->next;
+        free(alloc->blocks);
+        alloc->blocks = next;
+    }
+    while (alloc->evicted) {
+        block_t *next = alloc->evicted->next;
+        free(alloc->evicted->sysmem);
+        free(alloc->evicted);
+        alloc->evicted = next;
+    }
+    free(alloc);
+}
+
+static block_t *find_block(block_t *list, void *owner)
+{
+    while (list && list->owner != owner)
+        list = list->next;
+    return list;
+}
+
+/* Release a block and merge it with the free neighbours */
+static void release_block(block_t *b)
+{
+    b->owner = NULL;
+    if (b->next && !b->next->owner) {
+        block_t *next = b->next;
+        b->size += next->size;
+        b->next = next->next;
+        if (b->next)
+            b->next->prev = b;
+        free(next);
+    }
+    if (b->prev && !b->prev->owner) {
+        block_t *prev = b->prev;
+        prev->size += b->size;
+        prev->next = b->next;
+        if (prev->next)
+            prev->next->prev = prev;
+        free(b);
+    }
+}
+
+/* Move the least recently used owner to the system memory */
+static int evict_lru(offscreen_alloc_t *alloc)
+{
+    block_t *b, *lru = NULL;
+    block_t *record;
+
+    for (b = alloc->blocks; b; b = b->next) {
+        /* the clock may wrap around */
+        if (b->owner && (!lru || (int32_t)(b->last_use - lru->last_use) < 0))
+            lru = b;
+    }
+    if (!lru)
+        return 0;
+
+    record = calloc(sizeof(block_t), 1);
+    if (!record)
+        return 0;
+    record->sysmem = malloc(lru->size);
+    if (!record->sysmem) {
+        free(record);
+        return 0;
+    }
+    record->owner = lru->owner;
+    record->size  = lru->size;
+
+    alloc->evict(alloc->data, lru->owner, alloc->base + lru->offset,
+                 record->sysmem, lru->size);
+
+    record->next = alloc->evicted;
+    alloc->evicted = record;
+    release_block(lru);
+    return 1;
+}
+
+uint8_t *offscreen_alloc(offscreen_alloc_t *alloc, uint32_t size, void *owner)
+{
+    block_t *b, *best;
+
+    if (!owner || size == 0 || size > alloc->size)
+        return NULL;
+    size = (size + alloc->alignment - 1) & ~(alloc->alignment - 1);
+
+    while (1) {
+        best = NULL;
+        for (b = alloc->blocks; b; b = b->next) {
+            if (!b->owner && b->size >= size && (!best || b->size < best->size))
+                best = b;
+        }
+        if (best)
+            break;
+        if (!evict_lru(alloc))
+            return NULL;
+    }
+
+    /* split the remaining part off as a new free block */
+    if (best->size > size) {
+        block_t *rest = calloc(sizeof(block_t), 1);
+        if (!rest)
+            return NULL;
+        rest->offset = best->offset + size;
+        rest->size   = best->size - size;
+        rest->prev   = best;
+        rest->next   = best->next;
+        if (rest->next)
+            rest->next->prev = rest;
+        best->next = rest;
+        best->size = size;
+    }
+
+    best->owner    = owner;
+    best->last_use = ++alloc->clock;
+    return alloc->base + best->offset;
+}
+
+void offscreen_free(offscreen_alloc_t *alloc, void *owner)
+{
+    block_t *b = find_block(alloc->blocks, owner);
+    block_t **link;
+
+    if (!owner)
+        return;
+    if (b) {
+        release_block(b);
+        return;
+    }
+
+    for (link = &alloc->evicted; *link; link = &(*link)->next) {
+        if ((*link)->owner == owner) {
+            b = *link;
+            *link = b->next;
+            free(b->sysmem);
+            free(b);
+            return;
+        }
+    }
+}
+
+void offscreen_touch(offscreen_alloc_t *alloc, void *owner)
+{
+    block_t *b = find_block(alloc->blocks, owner);
+    if (b)
+        b->last_use = ++alloc->clock;
+}
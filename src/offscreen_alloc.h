@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OFFSCREEN_ALLOC_H
+#define OFFSCREEN_ALLOC_H
+
+#include <stdint.h>
+
+/*
+ * Best-fit allocator for the spare part of the framebuffer, which can be
+ * accessed by the 2D hardware. Every allocated area belongs to an 'owner'
+ * (such as a pixmap). When there is not enough space for a new area, the
+ * least recently used ones are evicted to the system memory: the allocator
+ * mallocs a buffer and the 'evict' callback moves the owner's data there.
+ * The evicted owners stay in the system memory until they are freed.
+ */
+typedef struct offscreen_alloc_t offscreen_alloc_t;
+
+/*
+ * Called to copy 'size' bytes of data from 'old_ptr' (in the offscreen
+ * memory) to 'new_ptr' and make the owner use it from now on.
+ */
+typedef void (*offscreen_evict_fn)(void    *data,
+                                   void    *owner,
+                                   uint8_t *old_ptr,
+                                   uint8_t *new_ptr,
+                                   uint32_t size);
+
+/*
+ * Manage 'size' bytes of memory at 'base', returning the addresses aligned
+ * at 'alignment' (must be a power of two) bytes relative to it.
+ */
+offscreen_alloc_t *offscreen_alloc_init(uint8_t           *base,
+                                        uint32_t           size,
+                                        uint32_t           alignment,
+                                        offscreen_evict_fn evict,
+                                        void              *data);
+void offscreen_alloc_close(offscreen_alloc_t *alloc);
+
+/*
+ * Allocate 'size' bytes for 'owner', evicting the other owners if needed.
+ * Returns NULL if this is not possible.
+ */
+uint8_t *offscreen_alloc(offscreen_alloc_t *alloc, uint32_t size, void *owner);
+
+/*
+ * Release the memory of 'owner', either the offscreen area or the system
+ * memory buffer after eviction. Does nothing for unknown owners.
+ */
+void offscreen_free(offscreen_alloc_t *alloc, void *owner);
+
+/* Mark the area of 'owner' as recently used */
+void offscreen_touch(offscreen_alloc_t *alloc, void *owner);
+
+#endif
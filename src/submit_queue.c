@@ -0,0 +1,200 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "submit_queue.h"
+#include "worker_pool.h"
+
+/* The number of queued requests (must be a power of two) */
+#define SUBMIT_QUEUE_SIZE 64
+
+struct submit_queue_t {
+    int               (*run)(void *self, void *requests, int n);
+    void               *self;
+    int                 request_size;
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond_submit;   /* a request is added or shutdown */
+    pthread_cond_t      cond_complete; /* some requests are finished */
+    /* These are protected by the lock */
+    int                 shutdown;
+    int                 failed;
+    uint32_t            submitted;     /* the sequence number of the last  */
+    uint32_t            completed;     /* submitted and completed requests */
+    /* The request with sequence number N is stored at N % SUBMIT_QUEUE_SIZE */
+    uint8_t            *requests;
+};
+
+static void *submit_queue_thread(void *arg)
+{
+    submit_queue_t *queue = (submit_queue_t *)arg;
+
+    pthread_mutex_lock(&queue->lock);
+    while (1) {
+        int first, n, done;
+
+        while (queue->completed == queue->submitted && !queue->shutdown)
+            pthread_cond_wait(&queue->cond_submit, &queue->lock);
+        /* the remaining requests are still done on shutdown */
+        if (queue->completed == queue->submitted)
+            break;
+
+        /*
+         * Take all the pending requests up to the end of the ring buffer.
+         * Their slots are not reused until they are completed.
+         */
+        first = (queue->completed + 1) & (SUBMIT_QUEUE_SIZE - 1);
+        n = queue->submitted - queue->completed;
+        if (n > SUBMIT_QUEUE_SIZE - first)
+            n = SUBMIT_QUEUE_SIZE - first;
+        pthread_mutex_unlock(&queue->lock);
+        done = queue->run(queue->self,
+                          queue->requests + first * queue->request_size, n);
+        pthread_mutex_lock(&queue->lock);
+
+        if (done < n) {
+            /* skip the failed request, but still try the following ones */
+            queue->failed = 1;
+            n = done + 1;
+        }
+        queue->completed += n;
+        pthread_cond_broadcast(&queue->cond_complete);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+static void free_queue(submit_queue_t *queue)
+{
+    pthread_cond_destroy(&queue->cond_complete);
+    pthread_cond_destroy(&queue->cond_submit);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->requests);
+    free(queue);
+}
+
+submit_queue_t *submit_queue_init(int request_size,
+                                  int (*run)(void *self,
+                                             void *requests, int n),
+                                  void *self)
+{
+    submit_queue_t *queue = calloc(sizeof(submit_queue_t), 1);
+    if (!queue)
+        return NULL;
+    queue->requests = calloc(request_size, SUBMIT_QUEUE_SIZE);
+    if (!queue->requests) {
+        free(queue);
+        return NULL;
+    }
+    queue->run = run;
+    queue->self = self;
+    queue->request_size = request_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond_submit, NULL);
+    pthread_cond_init(&queue->cond_complete, NULL);
+
+    if (fbturbo_thread_create(&queue->thread,
+                              submit_queue_thread, queue) != 0) {
+        free_queue(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void submit_queue_close(submit_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->shutdown = 1;
+    pthread_cond_signal(&queue->cond_submit);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(queue->thread, NULL);
+    free_queue(queue);
+}
+
+int submit_queue_begin(submit_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!queue->failed)
+        return 0;
+    pthread_mutex_unlock(&queue->lock);
+    submit_queue_sync(queue);
+    return -1;
+}
+
+void *submit_queue_add(submit_queue_t *queue)
+{
+    int slot;
+    /* let the thread empty the queue if it is full */
+    while (queue->submitted - queue->completed >= SUBMIT_QUEUE_SIZE) {
+        pthread_cond_signal(&queue->cond_submit);
+        pthread_cond_wait(&queue->cond_complete, &queue->lock);
+    }
+    /* the caller fills the request before the lock is released again */
+    queue->submitted++;
+    slot = queue->submitted & (SUBMIT_QUEUE_SIZE - 1);
+    return queue->requests + slot * queue->request_size;
+}
+
+void submit_queue_end(submit_queue_t *queue)
+{
+    pthread_cond_signal(&queue->cond_submit);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+uint32_t submit_queue_fence(submit_queue_t *queue)
+{
+    uint32_t fence;
+    pthread_mutex_lock(&queue->lock);
+    fence = queue->submitted;
+    pthread_mutex_unlock(&queue->lock);
+    return fence;
+}
+
+int submit_queue_fence_done(submit_queue_t *queue, uint32_t fence)
+{
+    int done;
+    pthread_mutex_lock(&queue->lock);
+    /* the sequence numbers may wrap around */
+    done = (int32_t)(fence - queue->completed) <= 0;
+    pthread_mutex_unlock(&queue->lock);
+    return done;
+}
+
+void submit_queue_wait(submit_queue_t *queue, uint32_t fence)
+{
+    pthread_mutex_lock(&queue->lock);
+    while ((int32_t)(fence - queue->completed) > 0)
+        pthread_cond_wait(&queue->cond_complete, &queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void submit_queue_sync(submit_queue_t *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->completed != queue->submitted)
+        pthread_cond_wait(&queue->cond_complete, &queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+}
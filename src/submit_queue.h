@@ -0,0 +1,82 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SUBMIT_QUEUE_H
+#define SUBMIT_QUEUE_H
+
+#include <stdint.h>
+
+/*
+ * Asynchronous submission of the requests to a 2D accelerator. The requests
+ * are copied to a ring buffer and executed in the order by a separate thread,
+ * so that the X server does not have to wait for the ioctls. The requests
+ * themselves are opaque, the backend provides a callback to run them.
+ *
+ * Each queued request gets a sequence number, which serves as a fence:
+ * submit_queue_wait returns when all the requests up to and including the
+ * one with this number are finished.
+ *
+ * The errors of the queued requests can't be reported to the caller, the
+ * affected area is just left unchanged. Because a failure is usually not
+ * a one-off thing, the queue stops accepting requests after the first one
+ * and the backend is expected to do them synchronously from then on,
+ * letting its callers fall back to the CPU.
+ */
+typedef struct submit_queue_t submit_queue_t;
+
+/*
+ * Create a queue of requests, which are 'request_size' bytes each. The
+ * 'run(self, requests, n)' callback is called from the submission thread
+ * to execute 'n' requests stored one after another at 'requests'. It
+ * returns the number of the leading requests, which are done successfully
+ * (the next one is skipped as failed and the rest are passed to 'run'
+ * again). Returns NULL on failure.
+ */
+submit_queue_t *submit_queue_init(int request_size,
+                                  int (*run)(void *self,
+                                             void *requests, int n),
+                                  void *self);
+/* Finish the queued requests and destroy the queue */
+void submit_queue_close(submit_queue_t *queue);
+
+/*
+ * Adding the requests is done as submit_queue_begin, followed by one or
+ * more submit_queue_add calls and submit_queue_end. The queue is locked in
+ * between, so the requests are not started before submit_queue_end (unless
+ * the queue is full). If the queue has failed, submit_queue_begin waits for
+ * the remaining requests and returns -1 without locking.
+ */
+int submit_queue_begin(submit_queue_t *queue);
+/* Returns the storage for the next request (waiting for a free slot) */
+void *submit_queue_add(submit_queue_t *queue);
+void submit_queue_end(submit_queue_t *queue);
+
+/* The fence of the last added request */
+uint32_t submit_queue_fence(submit_queue_t *queue);
+/* Check whether the requests up to 'fence' are finished */
+int submit_queue_fence_done(submit_queue_t *queue, uint32_t fence);
+void submit_queue_wait(submit_queue_t *queue, uint32_t fence);
+/* Wait until all the queued requests are finished */
+void submit_queue_sync(submit_queue_t *queue);
+
+#endif
@@ -104,6 +104,7 @@ sunxi_disp_t *sunxi_disp_init(const char *device, void *xserver_fbmem)
     ctx->framebuffer_height = ctx->framebuffer_size /
                               (ctx->xres * ctx->bits_per_pixel / 8);
     ctx->gfx_layer_size = ctx->xres * ctx->yres * fb_var.bits_per_pixel / 8;
+    ctx->overlay_area_end = ctx->framebuffer_size;
 
     if (ctx->framebuffer_size < ctx->gfx_layer_size) {
         close(ctx->fd_fb);
@@ -159,9 +160,13 @@ sunxi_disp_t *sunxi_disp_init(const char *device, void *xserver_fbmem)
     }
 
     ctx->fd_g2d = open("/dev/g2d", O_RDWR);
+    ctx->g2d_tune_slot = -1;
 
     ctx->blt2d.self = ctx;
     ctx->blt2d.overlapped_blt = sunxi_g2d_blt;
+    ctx->blt2d.fill = sunxi_g2d_fill;
+    ctx->blt2d.blt_boxes = sunxi_g2d_blt_boxes;
+    ctx->blt2d.stretch_blt = sunxi_g2d_stretch_blt;
 
     return ctx;
 }
@@ -169,6 +174,13 @@ sunxi_disp_t *sunxi_disp_init(const char *device, void *xserver_fbmem)
 int sunxi_disp_close(sunxi_disp_t *ctx)
 {
     if (ctx->fd_disp >= 0) {
+        if (ctx->g2d_queue) {
+            /* finish the queued G2D operations */
+            submit_queue_close(ctx->g2d_queue);
+            ctx->g2d_queue = NULL;
+        }
+        if (ctx->tuner)
+            blt_tuner_close(ctx->tuner);
         if (ctx->fd_g2d >= 0) {
             close(ctx->fd_g2d);
         }
@@ -654,6 +666,150 @@ int sunxi_wait_for_vsync(sunxi_disp_t *ctx)
     return ioctl(ctx->fd_fb, FBIO_WAITFORVSYNC, 0);
 }
 
+/*****************************************************************************
+ * Asynchronous G2D command submission                                       *
+ *****************************************************************************/
+
+typedef struct {
+    int cmd;
+    int tune_slot; /* the blt_tuner slot or -1 */
+    union {
+        g2d_blt        blt;
+        g2d_fillrect   fill;
+        g2d_stretchblt stretch;
+    } arg;
+} g2d_request_t;
+
+/* The amount of data written by G2D_CMD_BITBLT (for blt_tuner) */
+static int sunxi_g2d_blt_bytes(const g2d_blt *blt)
+{
+    int bpp = blt->dst_image.format == G2D_FMT_RGB565 ? 2 : 4;
+    return blt->src_rect.w * blt->src_rect.h * bpp;
+}
+
+/* Do the ioctl, reporting the time if 'tune_slot' is valid */
+static int sunxi_g2d_run(sunxi_disp_t *disp, int cmd, int tune_slot,
+                         void *arg)
+{
+    int64_t t0;
+    int result;
+
+    if (tune_slot < 0)
+        return ioctl(disp->fd_g2d, cmd, arg);
+
+    t0 = blt_tuner_time_ns();
+    result = ioctl(disp->fd_g2d, cmd, arg);
+    if (result == 0)
+        blt_tuner_hw_sample(disp->tuner, tune_slot,
+                            sunxi_g2d_blt_bytes((g2d_blt *)arg),
+                            blt_tuner_time_ns() - t0);
+    return result;
+}
+
+/* The submit_queue callback */
+static int sunxi_g2d_run_requests(void *self, void *requests, int n)
+{
+    sunxi_disp_t *disp = (sunxi_disp_t *)self;
+    g2d_request_t *request = (g2d_request_t *)requests;
+    int i;
+    for (i = 0; i < n; i++) {
+        if (sunxi_g2d_run(disp, request[i].cmd, request[i].tune_slot,
+                          &request[i].arg) != 0)
+            return i;
+    }
+    return n;
+}
+
+int sunxi_g2d_enable_async(sunxi_disp_t *disp)
+{
+    if (disp->fd_g2d < 0)
+        return -1;
+    if (disp->g2d_queue)
+        return 0;
+
+    disp->g2d_queue = submit_queue_init(sizeof(g2d_request_t),
+                                        sunxi_g2d_run_requests, disp);
+    if (!disp->g2d_queue)
+        return -1;
+    disp->blt2d.sync = sunxi_g2d_sync;
+    return 0;
+}
+
+uint32_t sunxi_g2d_fence(sunxi_disp_t *disp)
+{
+    if (!disp->g2d_queue)
+        return 0;
+    return submit_queue_fence(disp->g2d_queue);
+}
+
+void sunxi_g2d_wait(sunxi_disp_t *disp, uint32_t fence)
+{
+    if (disp->g2d_queue)
+        submit_queue_wait(disp->g2d_queue, fence);
+}
+
+void sunxi_g2d_sync(void *self)
+{
+    sunxi_disp_t *disp = (sunxi_disp_t *)self;
+    if (disp->g2d_queue)
+        submit_queue_sync(disp->g2d_queue);
+}
+
+/* Copy the ioctl argument to the queue */
+static void sunxi_g2d_queue_request(sunxi_disp_t *disp, int cmd, void *arg)
+{
+    g2d_request_t *request = submit_queue_add(disp->g2d_queue);
+    request->cmd = cmd;
+    request->tune_slot = cmd == G2D_CMD_BITBLT ? disp->g2d_tune_slot : -1;
+    if (cmd == G2D_CMD_FILLRECT)
+        request->arg.fill = *(g2d_fillrect *)arg;
+    else if (cmd == G2D_CMD_STRETCHBLT)
+        request->arg.stretch = *(g2d_stretchblt *)arg;
+    else
+        request->arg.blt = *(g2d_blt *)arg;
+}
+
+/*
+ * Run G2D_CMD_BITBLT, G2D_CMD_FILLRECT or G2D_CMD_STRETCHBLT ioctl, or add
+ * it to the queue in the asynchronous mode (the argument is copied, so the
+ * caller may reuse it). Returns 0 on success.
+ */
+static int sunxi_g2d_ioctl(sunxi_disp_t *disp, int cmd, void *arg)
+{
+    if (disp->g2d_queue && submit_queue_begin(disp->g2d_queue) == 0) {
+        sunxi_g2d_queue_request(disp, cmd, arg);
+        submit_queue_end(disp->g2d_queue);
+        return 0;
+    }
+
+    return sunxi_g2d_run(disp, cmd,
+                         cmd == G2D_CMD_BITBLT ? disp->g2d_tune_slot : -1,
+                         arg);
+}
+
+/*
+ * Run or queue a batch of G2D_CMD_BITBLT requests (which are executed in
+ * the order). In the asynchronous mode, the whole batch is added to the
+ * queue at once. Returns 0 on success.
+ */
+static int sunxi_g2d_blt_batch(sunxi_disp_t *disp, g2d_blt *blt, int n)
+{
+    int i;
+
+    if (disp->g2d_queue && submit_queue_begin(disp->g2d_queue) == 0) {
+        for (i = 0; i < n; i++)
+            sunxi_g2d_queue_request(disp, G2D_CMD_BITBLT, &blt[i]);
+        submit_queue_end(disp->g2d_queue);
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (sunxi_g2d_run(disp, G2D_CMD_BITBLT, disp->g2d_tune_slot, &blt[i]))
+            return -1;
+    }
+    return 0;
+}
+
 /*****************************************************************************/
 
 int sunxi_g2d_fill_a8r8g8b8(sunxi_disp_t *disp,
@@ -684,7 +840,7 @@ int sunxi_g2d_fill_a8r8g8b8(sunxi_disp_t *disp,
     tmp.color               = color;
     tmp.alpha               = 0;
 
-    return ioctl(disp->fd_g2d, G2D_CMD_FILLRECT, &tmp);
+    return sunxi_g2d_ioctl(disp, G2D_CMD_FILLRECT, &tmp);
 }
 
 int sunxi_g2d_blit_a8r8g8b8(sunxi_disp_t *disp,
@@ -723,95 +879,113 @@ int sunxi_g2d_blit_a8r8g8b8(sunxi_disp_t *disp,
     tmp.color               = 0;
     tmp.alpha               = 0;
 
-    return ioctl(disp->fd_g2d, G2D_CMD_BITBLT, &tmp);
+    return sunxi_g2d_ioctl(disp, G2D_CMD_BITBLT, &tmp);
+}
+
+/*
+ * Prepare a single G2D_CMD_BITBLT request. The parameters are supposed to
+ * be already validated by the caller.
+ */
+static void sunxi_g2d_blt_request(sunxi_disp_t *disp, g2d_blt *blt,
+                                  uint8_t *src_bits, uint8_t *dst_bits,
+                                  int src_stride, int dst_stride,
+                                  int src_bpp, int dst_bpp,
+                                  int src_x, int src_y, int dst_x, int dst_y,
+                                  int w, int h)
+{
+    blt->flag                    = G2D_BLT_NONE;
+    blt->src_image.addr[0]       = disp->framebuffer_paddr +
+                                   (src_bits - disp->framebuffer_addr);
+    blt->src_rect.x              = src_x;
+    blt->src_rect.y              = src_y;
+    blt->src_rect.w              = w;
+    blt->src_rect.h              = h;
+    blt->src_image.h             = src_y + h;
+    if (src_bpp == 32) {
+        blt->src_image.w         = src_stride;
+        blt->src_image.format    = G2D_FMT_ARGB_AYUV8888;
+        blt->src_image.pixel_seq = G2D_SEQ_NORMAL;
+    }
+    else {
+        blt->src_image.w         = src_stride * 2;
+        blt->src_image.format    = G2D_FMT_RGB565;
+        blt->src_image.pixel_seq = G2D_SEQ_P10;
+    }
+
+    blt->dst_image.addr[0]       = disp->framebuffer_paddr +
+                                   (dst_bits - disp->framebuffer_addr);
+    blt->dst_x                   = dst_x;
+    blt->dst_y                   = dst_y;
+    blt->color                   = 0;
+    blt->alpha                   = 0;
+    blt->dst_image.h             = dst_y + h;
+    if (dst_bpp == 32) {
+        blt->dst_image.w         = dst_stride;
+        blt->dst_image.format    = G2D_FMT_ARGB_AYUV8888;
+        blt->dst_image.pixel_seq = G2D_SEQ_NORMAL;
+    }
+    else {
+        blt->dst_image.w         = dst_stride * 2;
+        blt->dst_image.format    = G2D_FMT_RGB565;
+        blt->dst_image.pixel_seq = G2D_SEQ_P10;
+    }
 }
 
 /*
  * The following function implements a 16bpp blit using 32bpp mode by
  * splitting the area into an aligned middle part (which is blit using
- * 32bpp mode) and left and right edges if required.
+ * 32bpp mode) and left and right edges if required. The requests are
+ * stored in 'blt' (at most 3) and their number is returned.
  *
  * It assumes the parameters have already been validated by the caller.
  * This includes the condition (src_x & 1) == (dst_x & 1), which is
  * necessary to be able to use 32bpp mode.
  */
 
-static int sunxi_g2d_blit_r5g6b5_in_three(sunxi_disp_t *disp, uint8_t *src_bits,
-    uint8_t *dst_bits, int src_stride, int dst_stride, int src_x, int src_y,
-    int dst_x, int dst_y, int w, int h)
+static int sunxi_g2d_r5g6b5_in_three(sunxi_disp_t *disp, g2d_blt *blt,
+    uint8_t *src_bits, uint8_t *dst_bits, int src_stride, int dst_stride,
+    int src_x, int src_y, int dst_x, int dst_y, int w, int h)
 {
-    g2d_blt tmp;
-    /* Set up the invariant blit parameters. */
-    tmp.flag                = G2D_BLT_NONE;
-    tmp.src_image.h         = src_y + h;
-    tmp.src_rect.y          = src_y;
-    tmp.src_rect.h          = h;
-    tmp.dst_image.h         = dst_y + h;
-    tmp.dst_y               = dst_y;
-    tmp.color               = 0;
-    tmp.alpha               = 0;
+    int n = 0;
 
     if (src_x & 1) {
-        tmp.src_image.addr[0]   = disp->framebuffer_paddr +
-                                  (src_bits - disp->framebuffer_addr);
-        tmp.src_image.format    = G2D_FMT_RGB565;
-        tmp.src_image.pixel_seq = G2D_SEQ_P10;
-        tmp.src_image.w         = src_stride * 2;
-        tmp.src_rect.x          = src_x;
-        tmp.src_rect.w          = 1;
-        tmp.dst_image.addr[0]   = disp->framebuffer_paddr +
-                                  (dst_bits - disp->framebuffer_addr);
-        tmp.dst_image.format    = G2D_FMT_RGB565;
-        tmp.dst_image.pixel_seq = G2D_SEQ_P10;
-        tmp.dst_image.w         = dst_stride * 2;
-        tmp.dst_x               = dst_x;
-        if (ioctl(disp->fd_g2d, G2D_CMD_BITBLT, &tmp))
-            return 0;
+        sunxi_g2d_blt_request(disp, &blt[n++], src_bits, dst_bits,
+                              src_stride, dst_stride, 16, 16,
+                              src_x, src_y, dst_x, dst_y, 1, h);
         src_x++;
         dst_x++;
         w--;
     }
     if (w >= 2) {
-        int w2;
-        tmp.src_image.addr[0]   = disp->framebuffer_paddr +
-                                  (src_bits - disp->framebuffer_addr);
-        tmp.src_image.format    = G2D_FMT_ARGB_AYUV8888;
-        tmp.src_image.pixel_seq = G2D_SEQ_NORMAL;
-        tmp.src_image.w         = src_stride;
-        tmp.src_rect.x          = src_x >> 1;
-        tmp.src_rect.w          = w >> 1;
-        tmp.dst_image.addr[0]   = disp->framebuffer_paddr +
-                                  (dst_bits - disp->framebuffer_addr);
-        tmp.dst_image.format    = G2D_FMT_ARGB_AYUV8888;
-        tmp.dst_image.pixel_seq = G2D_SEQ_NORMAL;
-        tmp.dst_image.w         = dst_stride;
-        tmp.dst_x               = dst_x >> 1;
-        if (ioctl(disp->fd_g2d, G2D_CMD_BITBLT, &tmp))
-            return 0;
-        w2 = (w >> 1) * 2;
+        int w2 = (w >> 1) * 2;
+        sunxi_g2d_blt_request(disp, &blt[n++], src_bits, dst_bits,
+                              src_stride, dst_stride, 32, 32,
+                              src_x >> 1, src_y, dst_x >> 1, dst_y,
+                              w >> 1, h);
         src_x += w2;
         dst_x += w2;
         w &= 1;
     }
     if (w) {
-        tmp.src_image.addr[0]   = disp->framebuffer_paddr +
-                                  (src_bits - disp->framebuffer_addr);
-        tmp.src_image.format    = G2D_FMT_RGB565;
-        tmp.src_image.pixel_seq = G2D_SEQ_P10;
-        tmp.src_image.w         = src_stride * 2;
-        tmp.src_rect.x          = src_x;
-        tmp.src_rect.w          = 1;
-        tmp.dst_image.addr[0]   = disp->framebuffer_paddr +
-                                  (dst_bits - disp->framebuffer_addr);
-
-        tmp.dst_image.format    = G2D_FMT_RGB565;
-        tmp.dst_image.pixel_seq = G2D_SEQ_P10;
-        tmp.dst_image.w         = dst_stride * 2;
-        tmp.dst_x               = dst_x;
-        if (ioctl(disp->fd_g2d, G2D_CMD_BITBLT, &tmp))
-            return 0;
+        sunxi_g2d_blt_request(disp, &blt[n++], src_bits, dst_bits,
+                              src_stride, dst_stride, 16, 16,
+                              src_x, src_y, dst_x, dst_y, 1, h);
     }
-    return 1;
+    return n;
+}
+
+/* The blt_tuner kinds are indexed by (src_bpp == 32) * 2 + (dst_bpp == 32) */
+int sunxi_g2d_enable_tuning(sunxi_disp_t *disp)
+{
+    disp->tuner = blt_tuner_init(4);
+    if (!disp->tuner)
+        return -1;
+    blt_tuner_set_kind(disp->tuner, 0, "16bpp", 2,
+                       G2D_BLT_SIZE_THRESHOLD_16BPP);
+    blt_tuner_set_kind(disp->tuner, 1, "16->32bpp", 4, G2D_BLT_SIZE_THRESHOLD);
+    blt_tuner_set_kind(disp->tuner, 2, "32->16bpp", 2, G2D_BLT_SIZE_THRESHOLD);
+    blt_tuner_set_kind(disp->tuner, 3, "32bpp", 4, G2D_BLT_SIZE_THRESHOLD);
+    return 0;
 }
 
 static inline int sunxi_g2d_try_fallback_blt(void               *self,
@@ -829,15 +1003,17 @@ static inline int sunxi_g2d_try_fallback_blt(void               *self,
                                              int                 h)
 {
     sunxi_disp_t *disp = (sunxi_disp_t *)self;
-    if (disp->fallback_blt2d)
+    if (disp->fallback_blt2d) {
+        /* the CPU must not overtake the queued G2D operations */
+        sunxi_g2d_sync(disp);
         return disp->fallback_blt2d->overlapped_blt(disp->fallback_blt2d->self,
                                                     src_bits, dst_bits,
                                                     src_stride, dst_stride,
                                                     src_bpp, dst_bpp,
                                                     src_x, src_y,
                                                     dst_x, dst_y, w, h);
+    }
     return 0;
-
 }
 
 #define FALLBACK_BLT() sunxi_g2d_try_fallback_blt(self, src_bits,        \
@@ -846,6 +1022,173 @@ static inline int sunxi_g2d_try_fallback_blt(void               *self,
                                                   dst_bpp, src_x, src_y, \
                                                   dst_x, dst_y, w, h);
 
+/*
+ * The overlapping blits with the destination to the right of the source
+ * on the same rows can't be done by G2D directly. But they can be split
+ * into the column strips, which are not wider than the shift distance
+ * (so that each of them has no overlap), done from right to left. Up to
+ * this number of strips is allowed.
+ */
+#define G2D_MAX_STRIPS 16
+
+/* Enough for G2D_MAX_STRIPS done with sunxi_g2d_r5g6b5_in_three */
+#define G2D_MAX_BLT_REQUESTS (G2D_MAX_STRIPS * 3)
+
+/*
+ * Prepare the requests for the blit, which has passed all the checks in
+ * sunxi_g2d_blt (with 'in_three' set if sunxi_g2d_r5g6b5_in_three can be
+ * used). Returns the number of requests stored in 'blt'.
+ */
+static int sunxi_g2d_blt_requests(sunxi_disp_t       *disp,
+                                  g2d_blt            *blt,
+                                  int                 in_three,
+                                  uint32_t           *src_bits,
+                                  uint32_t           *dst_bits,
+                                  int                 src_stride,
+                                  int                 dst_stride,
+                                  int                 src_bpp,
+                                  int                 dst_bpp,
+                                  int                 src_x,
+                                  int                 src_y,
+                                  int                 dst_x,
+                                  int                 dst_y,
+                                  int                 w,
+                                  int                 h)
+{
+    int n = 0;
+    int strip_w = w;
+
+    if (src_bits == dst_bits && src_y == dst_y && src_x + 1 < dst_x)
+        strip_w = dst_x - src_x;
+
+    /* from right to left */
+    while (w > 0) {
+        int x, sw = w < strip_w ? w : strip_w;
+        w -= sw;
+        x = w;
+        if (in_three)
+            n += sunxi_g2d_r5g6b5_in_three(disp, blt + n,
+                    (uint8_t *)src_bits, (uint8_t *)dst_bits,
+                    src_stride, dst_stride, src_x + x, src_y,
+                    dst_x + x, dst_y, sw, h);
+        else
+            sunxi_g2d_blt_request(disp, &blt[n++],
+                    (uint8_t *)src_bits, (uint8_t *)dst_bits,
+                    src_stride, dst_stride, src_bpp, dst_bpp,
+                    src_x + x, src_y, dst_x + x, dst_y, sw, h);
+    }
+    return n;
+}
+
+static int sunxi_g2d_blt_submit(sunxi_disp_t *disp, g2d_blt *blt, int n)
+{
+    int result = sunxi_g2d_blt_batch(disp, blt, n) == 0;
+    disp->g2d_tune_slot = -1;
+    return result;
+}
+
+/*
+ * Hybrid mode: G2D and the CPU can't saturate the memory bandwidth on their
+ * own, so the large blits are split into two bands of rows. G2D copies the
+ * top band in the background, while the CPU is copying the bottom band. The
+ * ratio is adjusted after each blit depending on which of them has finished
+ * first (so that they would finish at about the same time).
+ */
+
+/* The blits, which are smaller than this (in bytes), are not split */
+#define G2D_HYBRID_MIN_BYTES (256 * 1024)
+
+/* The CPU part is in 1/256 units */
+#define G2D_HYBRID_CPU_SHARE_MIN     16
+#define G2D_HYBRID_CPU_SHARE_MAX     240
+#define G2D_HYBRID_CPU_SHARE_DEFAULT 96
+#define G2D_HYBRID_CPU_SHARE_STEP    2
+
+int sunxi_g2d_enable_hybrid(sunxi_disp_t *disp)
+{
+    if (!disp->g2d_queue)
+        return -1;
+    disp->hybrid_blt = 1;
+    disp->hybrid_cpu_share = G2D_HYBRID_CPU_SHARE_DEFAULT;
+    return 0;
+}
+
+/* The bands can be copied concurrently only if the blit has no overlap */
+static int sunxi_g2d_hybrid_ok(sunxi_disp_t       *disp,
+                               uint32_t           *src_bits,
+                               uint32_t           *dst_bits,
+                               int                 src_stride,
+                               int                 dst_stride,
+                               int                 src_bpp,
+                               int                 dst_bpp,
+                               int                 src_x,
+                               int                 src_y,
+                               int                 dst_x,
+                               int                 dst_y,
+                               int                 w,
+                               int                 h)
+{
+    if (!disp->g2d_queue || !disp->fallback_blt2d || h < 32 ||
+        w * h * (dst_bpp / 8) < G2D_HYBRID_MIN_BYTES)
+        return 0;
+    if (src_bits != dst_bits)
+        return 1;
+    if (src_stride != dst_stride || src_bpp != dst_bpp)
+        return 0;
+    return src_y + h <= dst_y || dst_y + h <= src_y ||
+           src_x + w <= dst_x || dst_x + w <= src_x;
+}
+
+static int sunxi_g2d_blt_hybrid(sunxi_disp_t       *disp,
+                                int                 in_three,
+                                uint32_t           *src_bits,
+                                uint32_t           *dst_bits,
+                                int                 src_stride,
+                                int                 dst_stride,
+                                int                 src_bpp,
+                                int                 dst_bpp,
+                                int                 src_x,
+                                int                 src_y,
+                                int                 dst_x,
+                                int                 dst_y,
+                                int                 w,
+                                int                 h)
+{
+    blt2d_i *cpu = disp->fallback_blt2d;
+    int h_cpu = (h * disp->hybrid_cpu_share) >> 8;
+    int h_hw = h - h_cpu;
+    uint32_t fence;
+    g2d_blt blt[3];
+    int n;
+
+    /* the CPU band must not race with the previously queued requests */
+    sunxi_g2d_sync(disp);
+
+    n = sunxi_g2d_blt_requests(disp, blt, in_three, src_bits, dst_bits,
+                                   src_stride, dst_stride, src_bpp, dst_bpp,
+                                   src_x, src_y, dst_x, dst_y, w, h_hw);
+    if (!sunxi_g2d_blt_submit(disp, blt, n))
+        return 0;
+    fence = sunxi_g2d_fence(disp);
+
+    if (!cpu->overlapped_blt(cpu->self, src_bits, dst_bits,
+                             src_stride, dst_stride, src_bpp, dst_bpp,
+                             src_x, src_y + h_hw, dst_x, dst_y + h_hw,
+                             w, h_cpu))
+        return 0;
+
+    /* give more work to the one, which has been waiting for the other */
+    if (submit_queue_fence_done(disp->g2d_queue, fence)) {
+        if (disp->hybrid_cpu_share > G2D_HYBRID_CPU_SHARE_MIN)
+            disp->hybrid_cpu_share -= G2D_HYBRID_CPU_SHARE_STEP;
+    }
+    else {
+        if (disp->hybrid_cpu_share < G2D_HYBRID_CPU_SHARE_MAX)
+            disp->hybrid_cpu_share += G2D_HYBRID_CPU_SHARE_STEP;
+    }
+    return 1;
+}
+
 /*
  * G2D counterpart for pixman_blt (function arguments are the same with
  * only sunxi_disp_t extra argument added). Supports 16bpp (r5g6b5) and
@@ -870,7 +1213,9 @@ int sunxi_g2d_blt(void               *self,
 {
     sunxi_disp_t *disp = (sunxi_disp_t *)self;
     int blt_size_threshold;
-    g2d_blt tmp;
+    int in_three;
+    g2d_blt blt[G2D_MAX_BLT_REQUESTS];
+    int n;
 
     /* Zero size blit, nothing to do */
     if (w <= 0 || h <= 0)
@@ -894,70 +1239,277 @@ int sunxi_g2d_blt(void               *self,
     /*
      * If the area is smaller than G2D_BLT_SIZE_THRESHOLD, prefer to avoid the
      * overhead of G2D and do a CPU blit instead. There is a special threshold
-     * for 16bpp to 16bpp copy.
+     * for 16bpp to 16bpp copy. The tuner makes this decision later instead.
      */
     if (src_bpp == 16 && dst_bpp == 16)
         blt_size_threshold = G2D_BLT_SIZE_THRESHOLD_16BPP;
     else
         blt_size_threshold = G2D_BLT_SIZE_THRESHOLD;
-    if (w * h < blt_size_threshold)
+    if (!disp->tuner && w * h < blt_size_threshold)
         return FALLBACK_BLT();
 
-    /* Unsupported overlapping type */
-    if (src_bits == dst_bits && src_y == dst_y && src_x + 1 < dst_x)
+    /* Too many strips are needed for this overlapping type */
+    if (src_bits == dst_bits && src_y == dst_y && src_x + 1 < dst_x &&
+        (w + (dst_x - src_x) - 1) / (dst_x - src_x) > G2D_MAX_STRIPS)
         return FALLBACK_BLT();
 
     if (disp->fd_g2d < 0)
         return FALLBACK_BLT();
 
-    /* Do a 16-bit using 32-bit mode if possible. */
-    if (src_bpp == 16 && dst_bpp == 16 && (src_x & 1) == (dst_x & 1))
-        /* Check whether the overlapping type is supported, the condition */
-        /* is slightly different compared to the regular blit. */
-        if (!(src_bits == dst_bits && src_y == dst_y && src_x < dst_x))
-            return sunxi_g2d_blit_r5g6b5_in_three(disp, (uint8_t *)src_bits,
-                (uint8_t *)dst_bits, src_stride, dst_stride, src_x, src_y,
-                dst_x, dst_y, w, h);
-
     if ((src_bpp != 16 && src_bpp != 32) || (dst_bpp != 16 && dst_bpp != 32))
         return FALLBACK_BLT();
 
-    tmp.flag                    = G2D_BLT_NONE;
-    tmp.src_image.addr[0]       = disp->framebuffer_paddr +
-                                  ((uint8_t *)src_bits - disp->framebuffer_addr);
-    tmp.src_rect.x              = src_x;
-    tmp.src_rect.y              = src_y;
-    tmp.src_rect.w              = w;
-    tmp.src_rect.h              = h;
-    tmp.src_image.h             = src_y + h;
-    if (src_bpp == 32) {
-        tmp.src_image.w         = src_stride;
-        tmp.src_image.format    = G2D_FMT_ARGB_AYUV8888;
-        tmp.src_image.pixel_seq = G2D_SEQ_NORMAL;
-    }
-    else if (src_bpp == 16) {
-        tmp.src_image.w         = src_stride * 2;
-        tmp.src_image.format    = G2D_FMT_RGB565;
-        tmp.src_image.pixel_seq = G2D_SEQ_P10;
-    }
-
-    tmp.dst_image.addr[0]       = disp->framebuffer_paddr +
-                                  ((uint8_t *)dst_bits - disp->framebuffer_addr);
-    tmp.dst_x                   = dst_x;
-    tmp.dst_y                   = dst_y;
-    tmp.color                   = 0;
-    tmp.alpha                   = 0;
-    tmp.dst_image.h             = dst_y + h;
-    if (dst_bpp == 32) {
-        tmp.dst_image.w         = dst_stride;
-        tmp.dst_image.format    = G2D_FMT_ARGB_AYUV8888;
-        tmp.dst_image.pixel_seq = G2D_SEQ_NORMAL;
+    /* Do a 16-bit using 32-bit mode if possible. */
+    in_three = src_bpp == 16 && dst_bpp == 16 && (src_x & 1) == (dst_x & 1);
+
+    n = sunxi_g2d_blt_requests(disp, blt, in_three, src_bits, dst_bits,
+                               src_stride, dst_stride, src_bpp, dst_bpp,
+                               src_x, src_y, dst_x, dst_y, w, h);
+
+    if (disp->tuner) {
+        int bytes = w * h * (dst_bpp / 8);
+        int kind = (src_bpp == 32) * 2 + (dst_bpp == 32);
+        int slot = blt_tuner_slot(kind, w * (dst_bpp / 8));
+        if (!blt_tuner_use_hw(disp->tuner, slot, bytes, n)) {
+            int64_t t0;
+            int done;
+            sunxi_g2d_sync(disp);
+            t0 = blt_tuner_time_ns();
+            done = FALLBACK_BLT();
+            if (done)
+                blt_tuner_cpu_sample(disp->tuner, slot, bytes,
+                                     blt_tuner_time_ns() - t0);
+            return done;
+        }
+        disp->g2d_tune_slot = slot;
+    }
+
+    if (disp->hybrid_blt && sunxi_g2d_hybrid_ok(disp, src_bits, dst_bits,
+                                                 src_stride, dst_stride,
+                                                 src_bpp, dst_bpp, src_x, src_y,
+                                                 dst_x, dst_y, w, h))
+        return sunxi_g2d_blt_hybrid(disp, in_three, src_bits, dst_bits,
+                                    src_stride, dst_stride, src_bpp, dst_bpp,
+                                    src_x, src_y, dst_x, dst_y, w, h);
+
+    return sunxi_g2d_blt_submit(disp, blt, n);
+}
+
+static inline int sunxi_g2d_try_fallback_fill(void               *self,
+                                              uint32_t           *bits,
+                                              int                 stride,
+                                              int                 bpp,
+                                              int                 x,
+                                              int                 y,
+                                              int                 w,
+                                              int                 h,
+                                              uint32_t            filler)
+{
+    sunxi_disp_t *disp = (sunxi_disp_t *)self;
+    if (disp->fallback_blt2d) {
+        /* the CPU must not overtake the queued G2D operations */
+        sunxi_g2d_sync(disp);
+        return disp->fallback_blt2d->fill(disp->fallback_blt2d->self,
+                                          bits, stride, bpp,
+                                          x, y, w, h, filler);
     }
-    else if (dst_bpp == 16) {
-        tmp.dst_image.w         = dst_stride * 2;
-        tmp.dst_image.format    = G2D_FMT_RGB565;
-        tmp.dst_image.pixel_seq = G2D_SEQ_P10;
+    return 0;
+}
+
+#define FALLBACK_FILL() sunxi_g2d_try_fallback_fill(self, bits, stride, \
+                                                    bpp, x, y, w, h,    \
+                                                    filler);
+
+/*
+ * G2D counterpart for pixman_fill (function arguments are the same with
+ * only sunxi_disp_t extra argument added). Supports 16bpp (r5g6b5) and
+ * 32bpp (a8r8g8b8) formats. The 16bpp fills are done in 32bpp mode for
+ * the aligned middle part, while the odd edge columns are passed to the
+ * fallback (same as in sunxi_g2d_r5g6b5_in_three).
+ *
+ * Can do G2D accelerated fills only if the buffer is inside framebuffer.
+ */
+int sunxi_g2d_fill(void               *self,
+                   uint32_t           *bits,
+                   int                 stride,
+                   int                 bpp,
+                   int                 x,
+                   int                 y,
+                   int                 w,
+                   int                 h,
+                   uint32_t            filler)
+{
+    sunxi_disp_t *disp = (sunxi_disp_t *)self;
+    g2d_fillrect tmp;
+
+    /* Zero size fill, nothing to do */
+    if (w <= 0 || h <= 0)
+        return 1;
+
+    if ((uint8_t *)bits < disp->framebuffer_addr ||
+        (uint8_t *)bits >= disp->framebuffer_addr + disp->framebuffer_size)
+    {
+        return FALLBACK_FILL();
     }
 
-    return ioctl(disp->fd_g2d, G2D_CMD_BITBLT, &tmp) == 0;
+    /* The small fills are faster on CPU */
+    if (w * h < G2D_FILL_SIZE_THRESHOLD || (bpp != 16 && bpp != 32) ||
+        disp->fd_g2d < 0)
+    {
+        return FALLBACK_FILL();
+    }
+
+    tmp.flag                = G2D_FIL_NONE;
+    tmp.dst_image.addr[0]   = disp->framebuffer_paddr +
+                              ((uint8_t *)bits - disp->framebuffer_addr);
+    tmp.dst_image.w         = stride;
+    tmp.dst_image.h         = y + h;
+    tmp.dst_image.format    = G2D_FMT_ARGB_AYUV8888;
+    tmp.dst_image.pixel_seq = G2D_SEQ_NORMAL;
+    tmp.dst_rect.y          = y;
+    tmp.dst_rect.h          = h;
+    tmp.alpha               = 0;
+
+    if (bpp == 32) {
+        tmp.dst_rect.x      = x;
+        tmp.dst_rect.w      = w;
+        tmp.color           = filler;
+        return sunxi_g2d_ioctl(disp, G2D_CMD_FILLRECT, &tmp) == 0;
+    }
+
+    /* 16bpp: the odd left column */
+    if (x & 1) {
+        if (!sunxi_g2d_try_fallback_fill(self, bits, stride, bpp,
+                                         x, y, 1, h, filler))
+            return 0;
+        x++;
+        w--;
+    }
+    /* 16bpp: the odd right column */
+    if (w & 1) {
+        if (!sunxi_g2d_try_fallback_fill(self, bits, stride, bpp,
+                                         x + w - 1, y, 1, h, filler))
+            return 0;
+        w--;
+    }
+    if (w == 0)
+        return 1;
+
+    tmp.dst_rect.x          = x >> 1;
+    tmp.dst_rect.w          = w >> 1;
+    tmp.color               = (filler & 0xFFFF) * 0x00010001;
+    return sunxi_g2d_ioctl(disp, G2D_CMD_FILLRECT, &tmp) == 0;
+}
+
+/*
+ * The blt2d_i::blt_boxes implementation on top of sunxi_g2d_blt. The adjacent
+ * boxes are merged to reduce the number of ioctls.
+ */
+int sunxi_g2d_blt_boxes(void               *self,
+                        uint32_t           *src_bits,
+                        uint32_t           *dst_bits,
+                        int                 src_stride,
+                        int                 dst_stride,
+                        int                 src_bpp,
+                        int                 dst_bpp,
+                        const blt2d_box_t  *boxes,
+                        int                 nboxes,
+                        int                 src_dx,
+                        int                 src_dy,
+                        int                 dst_dx,
+                        int                 dst_dy)
+{
+    int i = 0;
+    while (i < nboxes) {
+        blt2d_box_t b;
+        int n = blt2d_merge_boxes(boxes + i, nboxes - i, &b);
+        if (!sunxi_g2d_blt(self, src_bits, dst_bits, src_stride, dst_stride,
+                           src_bpp, dst_bpp, b.x1 + src_dx, b.y1 + src_dy,
+                           b.x1 + dst_dx, b.y1 + dst_dy,
+                           b.x2 - b.x1, b.y2 - b.y1))
+            return i;
+        i += n;
+    }
+    return nboxes;
+}
+
+/* Fill in g2d_image for the r5g6b5 or a8r8g8b8 picture in the framebuffer */
+static void sunxi_g2d_image(sunxi_disp_t *disp, g2d_image *image,
+                            uint32_t *bits, int stride, int bpp, int height)
+{
+    image->addr[0]       = disp->framebuffer_paddr +
+                           ((uint8_t *)bits - disp->framebuffer_addr);
+    image->h             = height;
+    if (bpp == 32) {
+        image->w         = stride;
+        image->format    = G2D_FMT_ARGB_AYUV8888;
+        image->pixel_seq = G2D_SEQ_NORMAL;
+    }
+    else {
+        image->w         = stride * 2;
+        image->format    = G2D_FMT_RGB565;
+        image->pixel_seq = G2D_SEQ_P10;
+    }
+}
+
+int sunxi_g2d_stretch_blt(void               *self,
+                          uint32_t           *src_bits,
+                          uint32_t           *dst_bits,
+                          int                 src_stride,
+                          int                 dst_stride,
+                          int                 src_bpp,
+                          int                 dst_bpp,
+                          int                 src_x,
+                          int                 src_y,
+                          int                 src_w,
+                          int                 src_h,
+                          int                 dst_x,
+                          int                 dst_y,
+                          int                 dst_w,
+                          int                 dst_h)
+{
+    sunxi_disp_t *disp = (sunxi_disp_t *)self;
+    g2d_stretchblt tmp;
+
+    if (dst_w <= 0 || dst_h <= 0)
+        return 1;
+    if (src_w <= 0 || src_h <= 0)
+        return 0;
+
+    /* The same minimal validation as in sunxi_g2d_blt */
+    if ((uint8_t *)src_bits < disp->framebuffer_addr ||
+        (uint8_t *)src_bits >= disp->framebuffer_addr + disp->framebuffer_size ||
+        (uint8_t *)dst_bits < disp->framebuffer_addr ||
+        (uint8_t *)dst_bits >= disp->framebuffer_addr + disp->framebuffer_size)
+    {
+        return 0;
+    }
+
+    /* Overlapping is not supported at all */
+    if (src_bits == dst_bits)
+        return 0;
+
+    if (dst_w * dst_h < G2D_STRETCH_SIZE_THRESHOLD || disp->fd_g2d < 0)
+        return 0;
+
+    if ((src_bpp != 16 && src_bpp != 32) || (dst_bpp != 16 && dst_bpp != 32))
+        return 0;
+
+    tmp.flag       = G2D_BLT_NONE;
+    sunxi_g2d_image(disp, &tmp.src_image, src_bits, src_stride, src_bpp,
+                    src_y + src_h);
+    tmp.src_rect.x = src_x;
+    tmp.src_rect.y = src_y;
+    tmp.src_rect.w = src_w;
+    tmp.src_rect.h = src_h;
+    sunxi_g2d_image(disp, &tmp.dst_image, dst_bits, dst_stride, dst_bpp,
+                    dst_y + dst_h);
+    tmp.dst_rect.x = dst_x;
+    tmp.dst_rect.y = dst_y;
+    tmp.dst_rect.w = dst_w;
+    tmp.dst_rect.h = dst_h;
+    tmp.color      = 0;
+    tmp.alpha      = 0;
+
+    return sunxi_g2d_ioctl(disp, G2D_CMD_STRETCHBLT, &tmp) == 0;
 }
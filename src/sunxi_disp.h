@@ -27,6 +27,8 @@
 #include <inttypes.h>
 
 #include "interfaces.h"
+#include "blt_tuner.h"
+#include "submit_queue.h"
 
 /*
  * Support for Allwinner A10 display controller features such as layers
@@ -44,6 +46,11 @@ typedef struct {
     uint32_t            framebuffer_size;  /* total size of the framebuffer */
     int                 framebuffer_height;/* virtual vertical resolution */
     uint32_t            gfx_layer_size;    /* the size of the primary layer */
+    /*
+     * XV and DRI2 use the offscreen memory from gfx_layer_size up to this
+     * offset (the rest may be reserved for the offscreen pixmaps)
+     */
+    uint32_t            overlay_area_end;
 
     uint8_t            *xserver_fbmem; /* framebuffer mapping done by xserver */
 
@@ -65,6 +72,14 @@ typedef struct {
     blt2d_i             blt2d;
     /* Optional fallback interface to handle unsupported operations */
     blt2d_i            *fallback_blt2d;
+    /* Not NULL if the G2D operations are submitted asynchronously */
+    submit_queue_t     *g2d_queue;
+    /* Not NULL if the blit size thresholds are learned at runtime */
+    blt_tuner_t        *tuner;
+    int                 g2d_tune_slot; /* of the blit being submitted */
+    /* Split the large blits between G2D and the CPU */
+    int                 hybrid_blt;
+    int                 hybrid_cpu_share; /* the CPU part in 1/256 units */
 } sunxi_disp_t;
 
 sunxi_disp_t *sunxi_disp_init(const char *fb_device, void *xserver_fbmem);
@@ -144,11 +159,25 @@ int sunxi_g2d_blit_a8r8g8b8(sunxi_disp_t *disp,
  * The following constants are used sunxi_disp.c and represent
  * the area threshold below which the sunxi_g2d_blit function will
  * return 0, indicating that a software blit is preferred. The
- * 16BPP constant applies to 16bpp to 16bpp blit.
+ * 16BPP constant applies to 16bpp to 16bpp blit. With
+ * sunxi_g2d_enable_tuning, they are only the initial values.
  */
 #define G2D_BLT_SIZE_THRESHOLD 1000
 #define G2D_BLT_SIZE_THRESHOLD_16BPP 2500
 
+/*
+ * The area threshold below which the sunxi_g2d_fill function passes
+ * the request to the fallback (CPU) implementation.
+ */
+#define G2D_FILL_SIZE_THRESHOLD 2000
+
+/*
+ * The destination area threshold below which the sunxi_g2d_stretch_blt
+ * function returns 0. Scaling is more expensive for the CPU than copying,
+ * so G2D pays off for the smaller areas too.
+ */
+#define G2D_STRETCH_SIZE_THRESHOLD 500
+
 /* G2D counterpart for pixman_blt with the support for 16bpp and 32bpp */
 int sunxi_g2d_blt(void               *disp,
                   uint32_t           *src_bits,
@@ -164,4 +193,82 @@ int sunxi_g2d_blt(void               *disp,
                   int                 w,
                   int                 h);
 
+/* G2D counterpart for pixman_fill with the support for 16bpp and 32bpp */
+int sunxi_g2d_fill(void               *disp,
+                   uint32_t           *bits,
+                   int                 stride,
+                   int                 bpp,
+                   int                 x,
+                   int                 y,
+                   int                 w,
+                   int                 h,
+                   uint32_t            filler);
+
+/* Batched sunxi_g2d_blt (see blt_boxes in blt2d_i) */
+int sunxi_g2d_blt_boxes(void               *self,
+                        uint32_t           *src_bits,
+                        uint32_t           *dst_bits,
+                        int                 src_stride,
+                        int                 dst_stride,
+                        int                 src_bpp,
+                        int                 dst_bpp,
+                        const blt2d_box_t  *boxes,
+                        int                 nboxes,
+                        int                 src_dx,
+                        int                 src_dy,
+                        int                 dst_dx,
+                        int                 dst_dy);
+
+/*
+ * Scale the src_w x src_h source rectangle to the dst_w x dst_h destination
+ * rectangle using G2D_CMD_STRETCHBLT (see stretch_blt in blt2d_i). There is
+ * no CPU fallback and 0 is returned if G2D can't do the job.
+ */
+int sunxi_g2d_stretch_blt(void               *self,
+                          uint32_t           *src_bits,
+                          uint32_t           *dst_bits,
+                          int                 src_stride,
+                          int                 dst_stride,
+                          int                 src_bpp,
+                          int                 dst_bpp,
+                          int                 src_x,
+                          int                 src_y,
+                          int                 src_w,
+                          int                 src_h,
+                          int                 dst_x,
+                          int                 dst_y,
+                          int                 dst_w,
+                          int                 dst_h);
+
+/*
+ * Measure the time of G2D blits and their CPU fallbacks and adjust the
+ * size thresholds, starting from which G2D is used, accordingly (for each
+ * combination of 16bpp and 32bpp formats and the width). Needs to be done
+ * before sunxi_g2d_enable_async. Returns 0 on success.
+ */
+int sunxi_g2d_enable_tuning(sunxi_disp_t *disp);
+
+/*
+ * Asynchronous G2D command submission. Once enabled, the G2D operations are
+ * passed to a separate submission thread and the functions above may return
+ * before they are actually done. Each queued operation gets a sequence
+ * number, which serves as a fence: sunxi_g2d_wait returns when all the
+ * operations up to and including the one with this number are finished.
+ *
+ * The CPU must not access the framebuffer without waiting for the last
+ * fence first. The sunxi_g2d_sync function does this and is also provided
+ * as blt2d_i::sync (it is a no-op if the asynchronous mode is not enabled).
+ */
+int sunxi_g2d_enable_async(sunxi_disp_t *disp);
+uint32_t sunxi_g2d_fence(sunxi_disp_t *disp);
+void sunxi_g2d_wait(sunxi_disp_t *disp, uint32_t fence);
+void sunxi_g2d_sync(void *disp);
+
+/*
+ * Let the CPU copy a part of each large non-overlapping blit, while G2D is
+ * copying the rest in the background. Needs the asynchronous mode and the
+ * fallback interface. Returns 0 on success.
+ */
+int sunxi_g2d_enable_hybrid(sunxi_disp_t *disp);
+
 #endif
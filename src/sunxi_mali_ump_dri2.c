@@ -44,6 +44,7 @@
 #include "sunxi_disp.h"
 #include "sunxi_disp_hwcursor.h"
 #include "sunxi_disp_ioctl.h"
+#include "sunxi_x_g2d.h"
 #include "sunxi_mali_ump_dri2.h"
 
 #define FBTURBO_DRI2INFOREC_VER 4
@@ -483,6 +484,9 @@ FBTurboPrepareAccess(PixmapPtr pPixmap, int index)
         FBTurboMaliDRI2 *mali = FBTURBO_MALI_DRI2(pScrn);
         BOInfoPtr bo = FBTurboGetPixmapDriverPrivate(pPixmap);
 
+	/* The buffer may be still used by the asynchronous G2D operations */
+	SunxiG2D_Sync(SUNXI_G2D(pScrn));
+
 	if (bo) {
 		if (!mali->bo_ops->valid(bo->handle)) {
 			INFO_MSG("%s: no handle", __func__);
@@ -807,7 +811,7 @@ MaliDRI2CreateBuffer2(ScreenPtr pScreen, DrawablePtr  pDraw,
     if (pDraw->bitsPerPixel != 32 && pDraw->bitsPerPixel != 16)
         can_use_overlay = FALSE;
 
-    if (disp && disp->framebuffer_size - disp->gfx_layer_size < privates->size * 2) {
+    if (disp && disp->overlay_area_end - disp->gfx_layer_size < privates->size * 2) {
         DEBUG_MSG(2,"DRI2CreateBuffer: Not enough space in the offscreen framebuffer (wanted %zd for DRI2)",
                  privates->size);
         can_use_overlay = FALSE;
@@ -823,7 +827,7 @@ MaliDRI2CreateBuffer2(ScreenPtr pScreen, DrawablePtr  pDraw,
         if (disp && can_use_overlay) {
             /* erase the offscreen part of the framebuffer */
             memset(disp->framebuffer_addr + disp->gfx_layer_size, 0,
-                   disp->framebuffer_size - disp->gfx_layer_size);
+                   disp->overlay_area_end - disp->gfx_layer_size);
         }
     }
     window_state->buf_request_cnt++;
@@ -1049,6 +1053,9 @@ static void MaliDRI2CopyRegion2_copy(ScreenPtr        pScreen,
     FreeScratchPixmapHeader(pScratchPixmap);
     FreeScratchGC(pGC);
 
+    /* The client may start rendering to the buffer again after this */
+    SunxiG2D_Sync(SUNXI_G2D(xf86Screens[pScreen->myNum]));
+
     if (bo_ops->valid(bo->handle)) {
         /* That's a normal BO allocation, not a wrapped framebuffer */
         bo_ops->switch_hw_usage(bo->handle, FALSE);
@@ -1656,7 +1663,7 @@ FBTurboMaliDRI2 *FBTurboMaliDRI2_Init(ScreenPtr pScreen,
             mali->ump_alternative_fb_secure_id = FBTURBO_BO_INVALID_SECURE_ID;
         }
 
-        if (disp->framebuffer_size - disp->gfx_layer_size <
+        if (disp->overlay_area_end - disp->gfx_layer_size <
                                                  disp->xres * disp->yres * 4 * 2) {
             int needed_fb_num = (disp->xres * disp->yres * 4 * 2 +
                                  disp->gfx_layer_size - 1) / disp->gfx_layer_size + 1;
@@ -172,11 +172,11 @@ xPutImage(ScrnInfoPtr pScrn, short src_x, short src_y, short drw_x, short drw_y,
     if (disp) {
         /* Try to fixup overlay offset */
         if (self->overlay_data_offs < disp->gfx_layer_size ||
-            self->overlay_data_offs + yuv_size > disp->framebuffer_size) {
+            self->overlay_data_offs + yuv_size > disp->overlay_area_end) {
             self->overlay_data_offs = disp->gfx_layer_size;
         }
         /* If it is still wrong (not enough offscreen memory), then fail */
-        if (self->overlay_data_offs + yuv_size > disp->framebuffer_size)
+        if (self->overlay_data_offs + yuv_size > disp->overlay_area_end)
             return BadImplementation;
 
         y_offset += self->overlay_data_offs;
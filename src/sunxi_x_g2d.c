@@ -34,10 +34,85 @@
 #include "damage.h"
 #include "fb.h"
 #include "gcstruct.h"
+#include "picturestr.h"
+#include "mipict.h"
+#include "dixfontstr.h"
+#include "servermd.h"
 
 #include "fbdev_priv.h"
 #include "sunxi_x_g2d.h"
 
+/*
+ * The blt2d operations may be still running in the background after the
+ * functions return (if blt2d_sync is provided). The CPU has to wait for
+ * them before accessing the framebuffer, but the other drawables can be
+ * used right away.
+ */
+
+static inline void
+xSync(SunxiG2D *private)
+{
+    if (private->blt2d_sync)
+        private->blt2d_sync(private->blt2d_self);
+}
+
+static void
+xSyncDrawable(DrawablePtr pDrawable)
+{
+    ScrnInfoPtr pScrn;
+    SunxiG2D *private;
+    PixmapPtr pPixmap;
+    uint8_t *bits;
+
+    if (!pDrawable)
+        return;
+    pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    private = SUNXI_G2D(pScrn);
+    if (!private->blt2d_sync)
+        return;
+
+    if (pDrawable->type == DRAWABLE_WINDOW)
+        pPixmap = fbGetWindowPixmap((WindowPtr)pDrawable);
+    else
+        pPixmap = (PixmapPtr)pDrawable;
+    bits = (uint8_t *)pPixmap->devPrivate.ptr;
+
+    if (bits >= private->fb_start && bits < private->fb_start + private->fb_size)
+        private->blt2d_sync(private->blt2d_self);
+}
+
+static void
+xSyncPicture(PicturePtr pPicture)
+{
+    if (!pPicture)
+        return;
+    xSyncDrawable(pPicture->pDrawable);
+    if (pPicture->alphaMap)
+        xSyncDrawable(pPicture->alphaMap->pDrawable);
+}
+
+/* Keep the recently copied pixmaps in the offscreen framebuffer memory */
+static void
+xTouchDrawable(DrawablePtr pDrawable)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PixmapPtr pPixmap;
+
+    if (!private->offscreen)
+        return;
+
+    if (pDrawable->type == DRAWABLE_WINDOW)
+        pPixmap = fbGetWindowPixmap((WindowPtr)pDrawable);
+    else
+        pPixmap = (PixmapPtr)pDrawable;
+
+    if (pPixmap->usage_hint == CREATE_PIXMAP_USAGE_BACKING_PIXMAP)
+        offscreen_touch(private->offscreen, pPixmap);
+}
+
+/*****************************************************************************/
+
 /*
  * The code below is borrowed from "xserver/fb/fbwindow.c"
  */
@@ -67,26 +142,34 @@ xCopyWindowProc(DrawablePtr pSrcDrawable,
     fbGetDrawable(pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
     fbGetDrawable(pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
-    while (nbox--) {
-        if (!private->blt2d_overlapped_blt(private->blt2d_self,
-                                           (uint32_t *)src, (uint32_t *)dst,
-                                           srcStride, dstStride,
-                                           srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
-                                           (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
-                                           (pbox->y1 + dstYoff), (pbox->x2 - pbox->x1),
-                                           (pbox->y2 - pbox->y1))) {
-            /* fallback to fbBlt */
-            fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
-                  srcStride,
-                  (pbox->x1 + dx + srcXoff) * srcBpp,
-                  dst + (pbox->y1 + dstYoff) * dstStride,
-                  dstStride,
-                  (pbox->x1 + dstXoff) * dstBpp,
-                  (pbox->x2 - pbox->x1) * dstBpp,
-                  (pbox->y2 - pbox->y1),
-                  GXcopy, FB_ALLONES, dstBpp, reverse, upsidedown);
-        }
+    while (nbox > 0) {
+        /* submit as many boxes as possible at once */
+        int done = private->blt2d_blt_boxes(private->blt2d_self,
+                                            (uint32_t *)src, (uint32_t *)dst,
+                                            srcStride, dstStride,
+                                            srcBpp, dstBpp,
+                                            (const blt2d_box_t *)pbox, nbox,
+                                            dx + srcXoff, dy + srcYoff,
+                                            dstXoff, dstYoff);
+        pbox += done;
+        nbox -= done;
+        if (nbox <= 0)
+            break;
+
+        /* fallback to fbBlt for the box, which could not be handled */
+        xSyncDrawable(pSrcDrawable);
+        xSyncDrawable(pDstDrawable);
+        fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
+              srcStride,
+              (pbox->x1 + dx + srcXoff) * srcBpp,
+              dst + (pbox->y1 + dstYoff) * dstStride,
+              dstStride,
+              (pbox->x1 + dstXoff) * dstBpp,
+              (pbox->x2 - pbox->x1) * dstBpp,
+              (pbox->y2 - pbox->y1),
+              GXcopy, FB_ALLONES, dstBpp, reverse, upsidedown);
         pbox++;
+        nbox--;
     }
 
     fbFinishAccess(pDstDrawable);
@@ -124,6 +207,38 @@ xCopyWindow(WindowPtr pWin, DDXPointRec ptOldOrg, RegionPtr prgnSrc)
 
 /*****************************************************************************/
 
+/*
+ * Convert between r5g6b5 and a8r8g8b8 formats using pixman. This is the
+ * fallback for the format converting copies, which can't be done by fbBlt.
+ */
+static Bool
+xConvertBlt(FbBits *src, FbStride srcStride, int srcBpp,
+            FbBits *dst, FbStride dstStride, int dstBpp,
+            int src_x, int src_y, int dst_x, int dst_y, int w, int h)
+{
+    pixman_image_t *src_image, *dst_image;
+
+    if ((srcBpp != 16 && srcBpp != 32) || (dstBpp != 16 && dstBpp != 32))
+        return FALSE;
+
+    src_image = pixman_image_create_bits(
+                    srcBpp == 16 ? PIXMAN_r5g6b5 : PIXMAN_x8r8g8b8,
+                    src_x + w, src_y + h, (uint32_t *)src,
+                    srcStride * sizeof(FbBits));
+    dst_image = pixman_image_create_bits(
+                    dstBpp == 16 ? PIXMAN_r5g6b5 : PIXMAN_a8r8g8b8,
+                    dst_x + w, dst_y + h, (uint32_t *)dst,
+                    dstStride * sizeof(FbBits));
+    if (src_image && dst_image)
+        pixman_image_composite(PIXMAN_OP_SRC, src_image, NULL, dst_image,
+                               src_x, src_y, 0, 0, dst_x, dst_y, w, h);
+    if (src_image)
+        pixman_image_unref(src_image);
+    if (dst_image)
+        pixman_image_unref(dst_image);
+    return src_image && dst_image;
+}
+
 static void
 xCopyNtoN(DrawablePtr pSrcDrawable,
           DrawablePtr pDstDrawable,
@@ -151,19 +266,33 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
     fbGetDrawable(pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
     fbGetDrawable(pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
-    while (nbox--) {
-        /* first try G2D */
-        Bool done = private->blt2d_overlapped_blt(
+    while (nbox > 0) {
+        Bool done;
+        /* first try G2D (as many boxes as possible at once) */
+        int nboxes_done = private->blt2d_blt_boxes(
                              private->blt2d_self,
                              (uint32_t *)src, (uint32_t *)dst,
                              srcStride, dstStride,
-                             srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
-                             (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
-                             (pbox->y1 + dstYoff), (pbox->x2 - pbox->x1),
-                             (pbox->y2 - pbox->y1));
+                             srcBpp, dstBpp,
+                             (const blt2d_box_t *)pbox, nbox,
+                             dx + srcXoff, dy + srcYoff,
+                             dstXoff, dstYoff);
+        pbox += nboxes_done;
+        nbox -= nboxes_done;
+        if (nbox <= 0)
+            break;
 
-        /* then pixman (NEON) */
-        if (!done && !reverse && !upsidedown) {
+        /* then pixman (NEON) for the box, which could not be handled */
+        xSyncDrawable(pSrcDrawable);
+        xSyncDrawable(pDstDrawable);
+        done = FALSE;
+        if (srcBpp != dstBpp) {
+            done = xConvertBlt(src, srcStride, srcBpp, dst, dstStride, dstBpp,
+                               (pbox->x1 + dx + srcXoff), (pbox->y1 + dy + srcYoff),
+                               (pbox->x1 + dstXoff), (pbox->y1 + dstYoff),
+                               (pbox->x2 - pbox->x1), (pbox->y2 - pbox->y1));
+        }
+        else if (!reverse && !upsidedown) {
             done = pixman_blt((uint32_t *)src, (uint32_t *)dst, srcStride, dstStride,
                  srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
                  (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
@@ -183,6 +312,7 @@ xCopyNtoN(DrawablePtr pSrcDrawable,
                   (pbox->y2 - pbox->y1), alu, pm, dstBpp, reverse, upsidedown);
         }
         pbox++;
+        nbox--;
     }
 
     fbFinishAccess(pDstDrawable);
@@ -198,13 +328,23 @@ xCopyArea(DrawablePtr pSrcDrawable,
     CARD8 alu = pGC ? pGC->alu : GXcopy;
     FbBits pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
 
-    if (pm == FB_ALLONES && alu == GXcopy && 
-        pSrcDrawable->bitsPerPixel == pDstDrawable->bitsPerPixel &&
-        (pSrcDrawable->bitsPerPixel == 32 || pSrcDrawable->bitsPerPixel == 16))
+    xTouchDrawable(pSrcDrawable);
+    xTouchDrawable(pDstDrawable);
+
+    /*
+     * Also handle r5g6b5 <-> a8r8g8b8 conversion (the CPU backend and G2D
+     * can do it). The core protocol needs matching depths, so only server
+     * internal callers may request such copies.
+     */
+    if (pm == FB_ALLONES && alu == GXcopy &&
+        (pSrcDrawable->bitsPerPixel == 32 || pSrcDrawable->bitsPerPixel == 16) &&
+        (pDstDrawable->bitsPerPixel == 32 || pDstDrawable->bitsPerPixel == 16))
     {
         return miDoCopy(pSrcDrawable, pDstDrawable, pGC, xIn, yIn,
                     widthSrc, heightSrc, xOut, yOut, xCopyNtoN, 0, 0);
     }
+    xSyncDrawable(pSrcDrawable);
+    xSyncDrawable(pDstDrawable);
     return fbCopyArea(pSrcDrawable,
                       pDstDrawable,
                       pGC,
@@ -233,6 +373,9 @@ static void xPutImage(DrawablePtr pDrawable,
     BoxPtr pbox;
     int x1, y1, x2, y2;
 
+    /* everything is done by the CPU here */
+    xSyncDrawable(pDrawable);
+
     if (format == XYBitmap || format == XYPixmap ||
     pDrawable->bitsPerPixel != BitsPerPixel(pDrawable->depth)) {
         fbPutImage(pDrawable, pGC, depth, x, y, w, h, leftPad, format, pImage);
@@ -301,6 +444,697 @@ static void xPutImage(DrawablePtr pDrawable,
     fbFinishAccess(pDrawable);
 }
 
+/*
+ * Solid fills, adapted from xserver/fb/fbfillrect.c and xserver/fb/fbfill.c
+ */
+
+/*
+ * Fill with the 'filler' pixel value (replicated like in FbGCPrivRec) in the
+ * GXcopy mode, whatever the colors and the function of the GC are
+ */
+static void
+xFillSolid(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int width, int height,
+           FbBits filler)
+{
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int dstXoff, dstYoff;
+    ScreenPtr pScreen = pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    Bool done;
+
+    fbGetDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+
+    /* first try the blt2d backend (G2D, the kernel or the CPU) */
+    done = private->blt2d_fill(private->blt2d_self, (uint32_t *)dst,
+                               dstStride, dstBpp, x + dstXoff, y + dstYoff,
+                               width, height, filler);
+
+    /* then pixman (NEON) */
+    if (!done) {
+        xSyncDrawable(pDrawable);
+        done = pixman_fill((uint32_t *)dst, dstStride, dstBpp,
+                           x + dstXoff, y + dstYoff, width, height,
+                           filler);
+    }
+
+    /* fallback to fbSolid if other methods did not work */
+    if (!done)
+        fbSolid(dst + (y + dstYoff) * dstStride, dstStride,
+                (x + dstXoff) * dstBpp, dstBpp, width * dstBpp, height,
+                fbAnd(GXcopy, filler, FB_ALLONES),
+                fbXor(GXcopy, filler, FB_ALLONES));
+
+    fbFinishAccess(pDrawable);
+}
+
+/* Check whether the GC fills with a solid color in the GXcopy mode */
+static Bool
+xGCIsSolidCopy(GCPtr pGC)
+{
+    return pGC->fillStyle == FillSolid && pGC->alu == GXcopy &&
+           fbGetGCPrivate(pGC)->pm == FB_ALLONES;
+}
+
+/* The thin solid lines, which are drawn exactly as filled rectangles */
+static Bool
+xGCIsThinSolidCopy(GCPtr pGC)
+{
+    return xGCIsSolidCopy(pGC) && pGC->lineWidth == 0 &&
+           pGC->lineStyle == LineSolid;
+}
+
+/*
+ * Fill the rectangle (in the screen coordinates, the right and bottom edges
+ * are exclusive) clipped by the composite clip of the GC
+ */
+static void
+xFillBoxClipped(DrawablePtr pDrawable, GCPtr pGC,
+                int fullX1, int fullY1, int fullX2, int fullY2, FbBits filler)
+{
+    RegionPtr pClip = fbGetCompositeClip(pGC);
+    BoxPtr pextent = RegionExtents(pClip);
+    BoxPtr pbox;
+    int partX1, partX2, partY1, partY2;
+    int n;
+
+    if (fullX1 < pextent->x1)
+        fullX1 = pextent->x1;
+    if (fullY1 < pextent->y1)
+        fullY1 = pextent->y1;
+    if (fullX2 > pextent->x2)
+        fullX2 = pextent->x2;
+    if (fullY2 > pextent->y2)
+        fullY2 = pextent->y2;
+
+    if ((fullX1 >= fullX2) || (fullY1 >= fullY2))
+        return;
+    n = RegionNumRects(pClip);
+    if (n == 1) {
+        xFillSolid(pDrawable, pGC,
+                   fullX1, fullY1, fullX2 - fullX1, fullY2 - fullY1, filler);
+        return;
+    }
+    pbox = RegionRects(pClip);
+    /* clip the rectangle to each box in the clip region */
+    while (n--) {
+        partX1 = pbox->x1;
+        if (partX1 < fullX1)
+            partX1 = fullX1;
+        partY1 = pbox->y1;
+        if (partY1 < fullY1)
+            partY1 = fullY1;
+        partX2 = pbox->x2;
+        if (partX2 > fullX2)
+            partX2 = fullX2;
+        partY2 = pbox->y2;
+        if (partY2 > fullY2)
+            partY2 = fullY2;
+
+        pbox++;
+
+        if (partX1 < partX2 && partY1 < partY2)
+            xFillSolid(pDrawable, pGC, partX1, partY1,
+                       partX2 - partX1, partY2 - partY1, filler);
+    }
+}
+
+static void
+xPolyFillRect(DrawablePtr pDrawable, GCPtr pGC, int nrect, xRectangle *prect)
+{
+    int xorg, yorg;
+
+    if (!xGCIsSolidCopy(pGC)) {
+        xSyncDrawable(pDrawable);
+        fbPolyFillRect(pDrawable, pGC, nrect, prect);
+        return;
+    }
+
+    xorg = pDrawable->x;
+    yorg = pDrawable->y;
+
+    while (nrect--) {
+        int x = prect->x + xorg;
+        int y = prect->y + yorg;
+        xFillBoxClipped(pDrawable, pGC, x, y,
+                        x + (int) prect->width, y + (int) prect->height,
+                        fbGetGCPrivate(pGC)->xor);
+        prect++;
+    }
+}
+
+#define FB_GC_OPS(pGC) \
+    (SUNXI_G2D(xf86Screens[(pGC)->pScreen->myNum])->pFbGCOps)
+
+/* The spans are already in the screen coordinates, see fbFillSpans */
+static void
+xFillSpans(DrawablePtr pDrawable, GCPtr pGC, int n, DDXPointPtr ppt,
+           int *pwidth, int fSorted)
+{
+    if (!xGCIsSolidCopy(pGC)) {
+        xSyncDrawable(pDrawable);
+        FB_GC_OPS(pGC)->FillSpans(pDrawable, pGC, n, ppt, pwidth, fSorted);
+        return;
+    }
+
+    while (n--) {
+        xFillBoxClipped(pDrawable, pGC, ppt->x, ppt->y,
+                        ppt->x + *pwidth, ppt->y + 1,
+                        fbGetGCPrivate(pGC)->xor);
+        ppt++;
+        pwidth++;
+    }
+}
+
+/*
+ * Only the horizontal and vertical thin segments are handled here. Both
+ * endpoints are drawn, except for the last one with CapNotLast.
+ */
+static void
+xPolySegment(DrawablePtr pDrawable, GCPtr pGC, int nseg, xSegment *pSegs)
+{
+    int xorg = pDrawable->x;
+    int yorg = pDrawable->y;
+    int notLast = pGC->capStyle == CapNotLast;
+    FbBits filler = fbGetGCPrivate(pGC)->xor;
+    int i;
+
+    for (i = 0; i < nseg; i++) {
+        if (pSegs[i].x1 != pSegs[i].x2 && pSegs[i].y1 != pSegs[i].y2)
+            break;
+    }
+    if (i < nseg || !xGCIsThinSolidCopy(pGC)) {
+        xSyncDrawable(pDrawable);
+        FB_GC_OPS(pGC)->PolySegment(pDrawable, pGC, nseg, pSegs);
+        return;
+    }
+
+    for (i = 0; i < nseg; i++) {
+        int x1 = pSegs[i].x1, y1 = pSegs[i].y1;
+        int x2 = pSegs[i].x2, y2 = pSegs[i].y2;
+        if (notLast) {
+            if (x1 == x2 && y1 == y2)
+                continue;
+            /* step back from the last point towards the first one */
+            x2 += (x1 > x2) - (x1 < x2);
+            y2 += (y1 > y2) - (y1 < y2);
+        }
+        if (x1 > x2) {
+            int tmp = x1;
+            x1 = x2;
+            x2 = tmp;
+        }
+        if (y1 > y2) {
+            int tmp = y1;
+            y1 = y2;
+            y2 = tmp;
+        }
+        xFillBoxClipped(pDrawable, pGC, x1 + xorg, y1 + yorg,
+                        x2 + xorg + 1, y2 + yorg + 1, filler);
+    }
+}
+
+/*
+ * The thin rectangles are the same as closed polylines (see miPolyRectangle),
+ * which cover the w + 1 by h + 1 outline
+ */
+static void
+xPolyRectangle(DrawablePtr pDrawable, GCPtr pGC, int nrects,
+               xRectangle *pRects)
+{
+    int xorg = pDrawable->x;
+    int yorg = pDrawable->y;
+    FbBits filler = fbGetGCPrivate(pGC)->xor;
+
+    if (!xGCIsThinSolidCopy(pGC)) {
+        xSyncDrawable(pDrawable);
+        FB_GC_OPS(pGC)->PolyRectangle(pDrawable, pGC, nrects, pRects);
+        return;
+    }
+
+    while (nrects--) {
+        int x = pRects->x + xorg;
+        int y = pRects->y + yorg;
+        int w = pRects->width;
+        int h = pRects->height;
+        pRects++;
+
+        /* top and bottom edges */
+        xFillBoxClipped(pDrawable, pGC, x, y, x + w + 1, y + 1, filler);
+        if (h > 0)
+            xFillBoxClipped(pDrawable, pGC, x, y + h, x + w + 1, y + h + 1,
+                            filler);
+        /* left and right edges without the corners */
+        if (h > 1) {
+            xFillBoxClipped(pDrawable, pGC, x, y + 1, x + 1, y + h, filler);
+            if (w > 0)
+                xFillBoxClipped(pDrawable, pGC, x + w, y + 1,
+                                x + w + 1, y + h, filler);
+        }
+    }
+}
+
+/*
+ * Core text. The 1bpp glyphs are expanded to 8bpp masks (cached per glyph),
+ * so that the pixels can be handled without the bit twiddling of fb. Nothing
+ * is ever read back from the framebuffer: PolyText only stores the foreground
+ * into the set pixels of the glyphs, and ImageText expands the foreground and
+ * background of the whole run into a buffer in the cached memory, which is
+ * then copied to the destination by pixman (NEON).
+ */
+
+/* The memory used by the glyph cache of each screen */
+#define GLYPH_CACHE_SIZE    (1024 * 1024)
+/* Use fb for the ImageText runs, which need a larger buffer */
+#define GLYPH_RUN_MAX_BYTES (256 * 1024)
+
+/*
+ * Store 'fg' into the pixels of the 'w' x 'h' destination rectangle (which
+ * starts at 'dst' and has 'dstStride' bytes per row), for which the mask
+ * of the glyph 'tile' starting at (tx, ty) is set
+ */
+static void
+xGlyphPixels(uint8_t *dst, int dstStride, int bpp,
+             const glyph_tile_t *tile, int tx, int ty, int w, int h,
+             uint32_t fg)
+{
+    const uint8_t *a8 = tile->a8 + ty * tile->stride + tx;
+    int row, col;
+
+    for (row = 0; row < h; row++) {
+        if (bpp == 16) {
+            uint16_t *p = (uint16_t *)dst;
+            for (col = 0; col < w; col++)
+                if (a8[col])
+                    p[col] = fg;
+        }
+        else {
+            uint32_t *p = (uint32_t *)dst;
+            for (col = 0; col < w; col++)
+                if (a8[col])
+                    p[col] = fg;
+        }
+        a8 += tile->stride;
+        dst += dstStride;
+    }
+}
+
+/*
+ * Draw the glyphs in the foreground color clipped by the composite clip of
+ * the GC (x and y are in the screen coordinates). Returns FALSE if a glyph
+ * could not be expanded, the glyphs before it are drawn already then.
+ */
+static Bool
+xGlyphRunFg(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+            unsigned int nglyph, CharInfoPtr *ppci)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    RegionPtr pClip = fbGetCompositeClip(pGC);
+    BoxPtr pextent = RegionExtents(pClip);
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp, dstXoff, dstYoff;
+    uint8_t *dstBytes;
+    int dstByteStride;
+    unsigned int i;
+    Bool done = TRUE;
+
+    fbGetDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+    dstBytes = (uint8_t *)dst;
+    dstByteStride = dstStride * sizeof(FbBits);
+
+    for (i = 0; i < nglyph; i++) {
+        CharInfoPtr pci = ppci[i];
+        int gx = x + pci->metrics.leftSideBearing;
+        int gy = y - pci->metrics.ascent;
+        int gw = pci->metrics.rightSideBearing - pci->metrics.leftSideBearing;
+        int gh = pci->metrics.ascent + pci->metrics.descent;
+        const glyph_tile_t *tile;
+        BoxPtr pbox;
+        int n;
+
+        x += pci->metrics.characterWidth;
+        if (gw <= 0 || gh <= 0 || gx + gw <= pextent->x1 ||
+            gx >= pextent->x2 || gy + gh <= pextent->y1 || gy >= pextent->y2)
+            continue;
+
+        /* the tile is only valid until the next glyph_cache_get call */
+        tile = glyph_cache_get(private->glyph_cache, pci,
+                               (const uint8_t *)pci->bits,
+                               GLYPHWIDTHBYTESPADDED(pci), gw, gh,
+                               BITMAP_BIT_ORDER == MSBFirst);
+        if (!tile) {
+            done = FALSE;
+            break;
+        }
+
+        n = RegionNumRects(pClip);
+        pbox = RegionRects(pClip);
+        while (n--) {
+            int bx1 = pbox->x1 > gx ? pbox->x1 : gx;
+            int by1 = pbox->y1 > gy ? pbox->y1 : gy;
+            int bx2 = pbox->x2 < gx + gw ? pbox->x2 : gx + gw;
+            int by2 = pbox->y2 < gy + gh ? pbox->y2 : gy + gh;
+            pbox++;
+            if (bx1 >= bx2 || by1 >= by2)
+                continue;
+            xGlyphPixels(dstBytes + (by1 + dstYoff) * dstByteStride +
+                                    (bx1 + dstXoff) * (dstBpp / 8),
+                         dstByteStride, dstBpp, tile, bx1 - gx, by1 - gy,
+                         bx2 - bx1, by2 - by1, pGC->fgPixel);
+        }
+    }
+
+    fbFinishAccess(pDrawable);
+    return done;
+}
+
+/*
+ * Draw the background rectangle of ImageText together with the glyphs inside
+ * of it (clipped to the x1, y1, x2, y2 box in the screen coordinates). They
+ * are expanded into the buffer first and then copied out in one go for each
+ * box of the clip region. Returns FALSE without drawing anything on failure.
+ */
+static Bool
+xGlyphRunImage(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+               unsigned int nglyph, CharInfoPtr *ppci,
+               int x1, int y1, int x2, int y2)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    RegionPtr pClip = fbGetCompositeClip(pGC);
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp, dstXoff, dstYoff;
+    int bpp = pDrawable->bitsPerPixel;
+    int runStride = ((x2 - x1) * (bpp / 8) + 3) & ~3;
+    unsigned int i;
+    BoxPtr pbox;
+    int n;
+
+    if (runStride * (y2 - y1) > GLYPH_RUN_MAX_BYTES)
+        return FALSE;
+    if (runStride * (y2 - y1) > private->glyph_run_size) {
+        uint8_t *run = realloc(private->glyph_run, runStride * (y2 - y1));
+        if (!run)
+            return FALSE;
+        private->glyph_run = run;
+        private->glyph_run_size = runStride * (y2 - y1);
+    }
+
+    if (!pixman_fill((uint32_t *)private->glyph_run, runStride / 4, bpp,
+                     0, 0, x2 - x1, y2 - y1, pPriv->bg))
+        return FALSE;
+
+    for (i = 0; i < nglyph; i++) {
+        CharInfoPtr pci = ppci[i];
+        int gx = x + pci->metrics.leftSideBearing;
+        int gy = y - pci->metrics.ascent;
+        int gw = pci->metrics.rightSideBearing - pci->metrics.leftSideBearing;
+        int gh = pci->metrics.ascent + pci->metrics.descent;
+        int bx1 = gx > x1 ? gx : x1;
+        int by1 = gy > y1 ? gy : y1;
+        int bx2 = gx + gw < x2 ? gx + gw : x2;
+        int by2 = gy + gh < y2 ? gy + gh : y2;
+        const glyph_tile_t *tile;
+
+        x += pci->metrics.characterWidth;
+        if (gw <= 0 || gh <= 0 || bx1 >= bx2 || by1 >= by2)
+            continue;
+        tile = glyph_cache_get(private->glyph_cache, pci,
+                               (const uint8_t *)pci->bits,
+                               GLYPHWIDTHBYTESPADDED(pci), gw, gh,
+                               BITMAP_BIT_ORDER == MSBFirst);
+        if (!tile)
+            return FALSE;
+        xGlyphPixels(private->glyph_run + (by1 - y1) * runStride +
+                                          (bx1 - x1) * (bpp / 8),
+                     runStride, bpp, tile, bx1 - gx, by1 - gy,
+                     bx2 - bx1, by2 - by1, pGC->fgPixel);
+    }
+
+    fbGetDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+    xSyncDrawable(pDrawable);
+
+    n = RegionNumRects(pClip);
+    pbox = RegionRects(pClip);
+    while (n--) {
+        int bx1 = pbox->x1 > x1 ? pbox->x1 : x1;
+        int by1 = pbox->y1 > y1 ? pbox->y1 : y1;
+        int bx2 = pbox->x2 < x2 ? pbox->x2 : x2;
+        int by2 = pbox->y2 < y2 ? pbox->y2 : y2;
+        pbox++;
+        if (bx1 >= bx2 || by1 >= by2)
+            continue;
+        if (!pixman_blt((uint32_t *)private->glyph_run, (uint32_t *)dst,
+                        runStride / 4, dstStride, bpp, dstBpp,
+                        bx1 - x1, by1 - y1, bx1 + dstXoff, by1 + dstYoff,
+                        bx2 - bx1, by2 - by1)) {
+            fbBlt((FbBits *)(private->glyph_run + (by1 - y1) * runStride),
+                  runStride / sizeof(FbBits),
+                  (bx1 - x1) * bpp,
+                  dst + (by1 + dstYoff) * dstStride,
+                  dstStride,
+                  (bx1 + dstXoff) * dstBpp,
+                  (bx2 - bx1) * dstBpp,
+                  by2 - by1, GXcopy, FB_ALLONES, dstBpp, FALSE, FALSE);
+        }
+    }
+
+    fbFinishAccess(pDrawable);
+    return TRUE;
+}
+
+/* Returns FALSE if fb needs to be used to (re)draw the whole run */
+static Bool
+xGlyphRun(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+          unsigned int nglyph, CharInfoPtr *ppci, Bool image)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pDrawable->pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    FbGCPrivPtr pPriv = fbGetGCPrivate(pGC);
+    BoxPtr pextent = RegionExtents(fbGetCompositeClip(pGC));
+    int penX, xBack, yBack, x2Back, y2Back;
+    Bool inside = TRUE;
+    unsigned int i;
+
+    /* ImageText ignores the function and fill style of the GC */
+    if (!private->glyph_cache || pPriv->pm != FB_ALLONES ||
+        (pDrawable->bitsPerPixel != 16 && pDrawable->bitsPerPixel != 32) ||
+        (!image && !xGCIsSolidCopy(pGC)))
+        return FALSE;
+
+    x += pDrawable->x;
+    y += pDrawable->y;
+
+    if (!image) {
+        xSyncDrawable(pDrawable);
+        return xGlyphRunFg(pDrawable, pGC, x, y, nglyph, ppci);
+    }
+
+    /* the background rectangle, which is clipped to the clip extents */
+    penX = x;
+    for (i = 0; i < nglyph; i++)
+        penX += ppci[i]->metrics.characterWidth;
+    xBack = penX < x ? penX : x;
+    x2Back = penX < x ? x : penX;
+    yBack = y - FONTASCENT(pGC->font);
+    y2Back = y + FONTDESCENT(pGC->font);
+
+    /* the glyphs may stick out of it, they are drawn separately then */
+    penX = x;
+    for (i = 0; i < nglyph; i++) {
+        CharInfoPtr pci = ppci[i];
+        if (pci->metrics.rightSideBearing > pci->metrics.leftSideBearing &&
+            pci->metrics.ascent + pci->metrics.descent > 0 &&
+            (penX + pci->metrics.leftSideBearing < xBack ||
+             penX + pci->metrics.rightSideBearing > x2Back ||
+             y - pci->metrics.ascent < yBack ||
+             y + pci->metrics.descent > y2Back))
+            inside = FALSE;
+        penX += pci->metrics.characterWidth;
+    }
+
+    if (xBack < pextent->x1)
+        xBack = pextent->x1;
+    if (yBack < pextent->y1)
+        yBack = pextent->y1;
+    if (x2Back > pextent->x2)
+        x2Back = pextent->x2;
+    if (y2Back > pextent->y2)
+        y2Back = pextent->y2;
+
+    if (xBack < x2Back && yBack < y2Back &&
+        !xGlyphRunImage(pDrawable, pGC, x, y, nglyph, ppci,
+                        xBack, yBack, x2Back, y2Back))
+        return FALSE;
+
+    if (inside)
+        return TRUE;
+    xSyncDrawable(pDrawable);
+    return xGlyphRunFg(pDrawable, pGC, x, y, nglyph, ppci);
+}
+
+static void
+xImageGlyphBlt(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+               unsigned int nglyph, CharInfoPtr *ppci, void *pglyphBase)
+{
+    if (xGlyphRun(pDrawable, pGC, x, y, nglyph, ppci, TRUE))
+        return;
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->ImageGlyphBlt(pDrawable, pGC, x, y, nglyph, ppci,
+                                  pglyphBase);
+}
+
+static void
+xPolyGlyphBlt(DrawablePtr pDrawable, GCPtr pGC, int x, int y,
+              unsigned int nglyph, CharInfoPtr *ppci, void *pglyphBase)
+{
+    if (xGlyphRun(pDrawable, pGC, x, y, nglyph, ppci, FALSE))
+        return;
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->PolyGlyphBlt(pDrawable, pGC, x, y, nglyph, ppci,
+                                 pglyphBase);
+}
+
+/*
+ * The same as miPolyText8 and friends, but without going through GCOps.
+ * Returns the x coordinate after the text.
+ */
+static int
+xText(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+      unsigned char *chars, FontEncoding encoding, Bool image)
+{
+    CharInfoPtr charinfo[255]; /* the protocol limits the count to 255 */
+    unsigned long n, i;
+    int w = 0;
+
+    if (count > 255)
+        count = 255;
+    GetGlyphs(pGC->font, (unsigned long) count, chars, encoding, &n, charinfo);
+    for (i = 0; i < n; i++)
+        w += charinfo[i]->metrics.characterWidth;
+    if (n == 0)
+        return x;
+
+    if (image)
+        xImageGlyphBlt(pDrawable, pGC, x, y, n, charinfo,
+                       FONTGLYPHS(pGC->font));
+    else
+        xPolyGlyphBlt(pDrawable, pGC, x, y, n, charinfo,
+                      FONTGLYPHS(pGC->font));
+    return x + w;
+}
+
+static int
+xPolyText8(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+           char *chars)
+{
+    return xText(pDrawable, pGC, x, y, count, (unsigned char *)chars,
+                 Linear8Bit, FALSE);
+}
+
+static int
+xPolyText16(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+            unsigned short *chars)
+{
+    return xText(pDrawable, pGC, x, y, count, (unsigned char *)chars,
+                 FONTLASTROW(pGC->font) == 0 ? Linear16Bit : TwoD16Bit,
+                 FALSE);
+}
+
+static void
+xImageText8(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+            char *chars)
+{
+    xText(pDrawable, pGC, x, y, count, (unsigned char *)chars,
+          Linear8Bit, TRUE);
+}
+
+static void
+xImageText16(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int count,
+             unsigned short *chars)
+{
+    xText(pDrawable, pGC, x, y, count, (unsigned char *)chars,
+          FONTLASTROW(pGC->font) == 0 ? Linear16Bit : TwoD16Bit, TRUE);
+}
+
+/*
+ * The rest of GC operations are done by the CPU in fb, just wait for the
+ * blt2d operations first.
+ */
+
+static void
+xSetSpans(DrawablePtr pDrawable, GCPtr pGC, char *psrc, DDXPointPtr ppt,
+          int *pwidth, int nspans, int fSorted)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->SetSpans(pDrawable, pGC, psrc, ppt, pwidth, nspans,
+                             fSorted);
+}
+
+static RegionPtr
+xCopyPlane(DrawablePtr pSrcDrawable, DrawablePtr pDstDrawable, GCPtr pGC,
+           int xIn, int yIn, int widthSrc, int heightSrc, int xOut, int yOut,
+           unsigned long bitplane)
+{
+    xSyncDrawable(pSrcDrawable);
+    xSyncDrawable(pDstDrawable);
+    return FB_GC_OPS(pGC)->CopyPlane(pSrcDrawable, pDstDrawable, pGC,
+                                     xIn, yIn, widthSrc, heightSrc,
+                                     xOut, yOut, bitplane);
+}
+
+static void
+xPolyPoint(DrawablePtr pDrawable, GCPtr pGC, int mode, int npt,
+           DDXPointPtr ppt)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->PolyPoint(pDrawable, pGC, mode, npt, ppt);
+}
+
+static void
+xPolylines(DrawablePtr pDrawable, GCPtr pGC, int mode, int npt,
+           DDXPointPtr ppt)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->Polylines(pDrawable, pGC, mode, npt, ppt);
+}
+
+static void
+xPolyArc(DrawablePtr pDrawable, GCPtr pGC, int narcs, xArc *parcs)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->PolyArc(pDrawable, pGC, narcs, parcs);
+}
+
+static void
+xFillPolygon(DrawablePtr pDrawable, GCPtr pGC, int shape, int mode,
+             int count, DDXPointPtr pPts)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->FillPolygon(pDrawable, pGC, shape, mode, count, pPts);
+}
+
+static void
+xPolyFillArc(DrawablePtr pDrawable, GCPtr pGC, int narcs, xArc *parcs)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->PolyFillArc(pDrawable, pGC, narcs, parcs);
+}
+
+static void
+xPushPixels(GCPtr pGC, PixmapPtr pBitmap, DrawablePtr pDrawable,
+            int dx, int dy, int xOrg, int yOrg)
+{
+    xSyncDrawable(pDrawable);
+    FB_GC_OPS(pGC)->PushPixels(pGC, pBitmap, pDrawable, dx, dy, xOrg, yOrg);
+}
+
 static Bool
 xCreateGC(GCPtr pGC)
 {
@@ -312,6 +1146,7 @@ xCreateGC(GCPtr pGC)
         return FALSE;
 
     if (!self->pGCOps) {
+        self->pFbGCOps = pGC->ops;
         self->pGCOps = calloc(1, sizeof(GCOps));
         memcpy(self->pGCOps, pGC->ops, sizeof(GCOps));
 
@@ -319,6 +1154,30 @@ xCreateGC(GCPtr pGC)
         self->pGCOps->CopyArea = xCopyArea;
         /* Add our own hook for PutImage */
         self->pGCOps->PutImage = xPutImage;
+        /* Add our own hooks for solid fills and thin straight lines */
+        self->pGCOps->PolyFillRect = xPolyFillRect;
+        self->pGCOps->FillSpans = xFillSpans;
+        self->pGCOps->PolySegment = xPolySegment;
+        self->pGCOps->PolyRectangle = xPolyRectangle;
+        /* Add our own hooks for core text */
+        self->pGCOps->PolyText8 = xPolyText8;
+        self->pGCOps->PolyText16 = xPolyText16;
+        self->pGCOps->ImageText8 = xImageText8;
+        self->pGCOps->ImageText16 = xImageText16;
+        self->pGCOps->ImageGlyphBlt = xImageGlyphBlt;
+        self->pGCOps->PolyGlyphBlt = xPolyGlyphBlt;
+
+        /* Only wait for the asynchronous blt2d operations in the rest */
+        if (self->blt2d_sync) {
+            self->pGCOps->SetSpans = xSetSpans;
+            self->pGCOps->CopyPlane = xCopyPlane;
+            self->pGCOps->PolyPoint = xPolyPoint;
+            self->pGCOps->Polylines = xPolylines;
+            self->pGCOps->PolyArc = xPolyArc;
+            self->pGCOps->FillPolygon = xFillPolygon;
+            self->pGCOps->PolyFillArc = xPolyFillArc;
+            self->pGCOps->PushPixels = xPushPixels;
+        }
     }
     pGC->ops = self->pGCOps;
 
@@ -327,6 +1186,500 @@ xCreateGC(GCPtr pGC)
 
 /*****************************************************************************/
 
+/*
+ * Reading from the framebuffer (screenshots, VNC servers, ...) is slow if
+ * done directly from uncached memory, so use blt2d for ZPixmap requests.
+ * Adapted from xserver/fb/fbimage.c
+ */
+
+static void
+xGetImage(DrawablePtr pDrawable,
+          int x,
+          int y,
+          int w,
+          int h, unsigned int format, unsigned long planeMask, char *d)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    FbBits pm = FbFullMask(pDrawable->depth);
+    FbBits *src;
+    FbStride srcStride;
+    int srcBpp;
+    int srcXoff, srcYoff;
+    FbStride dstStride;
+    Bool done = FALSE;
+
+    if (format == ZPixmap && (planeMask & pm) == pm &&
+        pDrawable->bitsPerPixel >= 8 && fbDrawableEnabled(pDrawable))
+    {
+        fbGetDrawable(pDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
+        dstStride = PixmapBytePad(w, pDrawable->depth) / sizeof(uint32_t);
+        done = private->blt2d_overlapped_blt(private->blt2d_self,
+                                 (uint32_t *)src, (uint32_t *)d,
+                                 srcStride, dstStride, srcBpp, srcBpp,
+                                 x + pDrawable->x + srcXoff,
+                                 y + pDrawable->y + srcYoff,
+                                 0, 0, w, h);
+        fbFinishAccess(pDrawable);
+        /* the client reads the image right after this */
+        xSync(private);
+    }
+
+    if (!done) {
+        xSyncDrawable(pDrawable);
+        pScreen->GetImage = private->GetImage;
+        (*pScreen->GetImage) (pDrawable, x, y, w, h, format, planeMask, d);
+        pScreen->GetImage = xGetImage;
+    }
+}
+
+static void
+xGetSpans(DrawablePtr pDrawable, int wMax, DDXPointPtr ppt, int *pwidth,
+          int nspans, char *pdstStart)
+{
+    ScreenPtr pScreen = pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+
+    xSyncDrawable(pDrawable);
+    pScreen->GetSpans = private->GetSpans;
+    (*pScreen->GetSpans) (pDrawable, wMax, ppt, pwidth, nspans, pdstStart);
+    pScreen->GetSpans = xGetSpans;
+}
+
+/*****************************************************************************/
+
+/*
+ * Render is done by the CPU (pixman), so only wait for the asynchronous
+ * blt2d operations if the framebuffer is involved. The exception are the
+ * simple Composite requests (no mask, transform, repeat or alpha maps),
+ * which are used by the compositing managers to put the window pixmaps on
+ * the screen. These can be done as copies (PictOpSrc, or PictOpOver with
+ * an opaque source). The copies with a scale-only transform (image viewers,
+ * zooming) are passed to blt2d_stretch_blt.
+ */
+
+static PixmapPtr
+xGetDrawablePixmap(DrawablePtr pDrawable)
+{
+    if (pDrawable->type == DRAWABLE_WINDOW)
+        return fbGetWindowPixmap((WindowPtr)pDrawable);
+    return (PixmapPtr)pDrawable;
+}
+
+static Bool
+xCompositeIsCopy(CARD8 op, PictFormatShort src, PictFormatShort dst)
+{
+    if (op != PictOpSrc && !(op == PictOpOver && PICT_FORMAT_A(src) == 0))
+        return FALSE;
+    if (src == dst)
+        return TRUE;
+    /* Only the conversions, which don't need to fill the alpha channel */
+    return (src == PICT_a8r8g8b8 || src == PICT_x8r8g8b8 ||
+            src == PICT_r5g6b5) &&
+           (dst == PICT_x8r8g8b8 || dst == PICT_r5g6b5);
+}
+
+/*
+ * Returns FALSE if the request has to be passed to the wrapped Composite.
+ * The copy may be partially done by then (it's fine to redo it).
+ */
+static Bool
+xCompositeBlt(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
+              INT16 xSrc, INT16 ySrc, INT16 xDst, INT16 yDst,
+              CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    RegionRec region;
+    BoxPtr pbox;
+    int nbox;
+    Bool done;
+    FbBits *src;
+    FbStride srcStride;
+    int srcBpp;
+    int srcXoff, srcYoff;
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int dstXoff, dstYoff;
+
+    if (!pSrc->pDrawable || pSrc->transform || pSrc->repeat ||
+        pSrc->alphaMap || pDst->alphaMap)
+        return FALSE;
+    if ((pSrc->pDrawable->bitsPerPixel != 16 &&
+         pSrc->pDrawable->bitsPerPixel != 32) ||
+        (pDst->pDrawable->bitsPerPixel != 16 &&
+         pDst->pDrawable->bitsPerPixel != 32))
+        return FALSE;
+    /* Render does not define the result of overlapping copies anyway */
+    if (xGetDrawablePixmap(pSrc->pDrawable) ==
+        xGetDrawablePixmap(pDst->pDrawable))
+        return FALSE;
+
+    if (!xCompositeIsCopy(op, pSrc->format, pDst->format))
+        return FALSE;
+
+    xDst += pDst->pDrawable->x;
+    yDst += pDst->pDrawable->y;
+    xSrc += pSrc->pDrawable->x;
+    ySrc += pSrc->pDrawable->y;
+
+    miCompositeSourceValidate(pSrc);
+    if (!miComputeCompositeRegion(&region, pSrc, NULL, pDst, xSrc, ySrc,
+                                  0, 0, xDst, yDst, width, height))
+        return TRUE;
+
+    fbGetDrawable(pSrc->pDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
+    fbGetDrawable(pDst->pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+
+    pbox = RegionRects(&region);
+    nbox = RegionNumRects(&region);
+
+    done = private->blt2d_blt_boxes(private->blt2d_self,
+                                    (uint32_t *)src, (uint32_t *)dst,
+                                    srcStride, dstStride, srcBpp, dstBpp,
+                                    (const blt2d_box_t *)pbox, nbox,
+                                    xSrc - xDst + srcXoff,
+                                    ySrc - yDst + srcYoff,
+                                    dstXoff, dstYoff) == nbox;
+
+    fbFinishAccess(pDst->pDrawable);
+    fbFinishAccess(pSrc->pDrawable);
+    RegionUninit(&region);
+    return done;
+}
+
+/* Returns -1 or 65536 for the results, which are out of any drawable */
+static int
+xMapEdge(int x, xFixed scale, xFixed offset)
+{
+    int64_t v = (int64_t)x * scale + offset + pixman_fixed_1 / 2;
+    if (v < 0)
+        return -1;
+    if (v >= ((int64_t)65536 << 16))
+        return 65536;
+    return (int)(v >> 16);
+}
+
+/*
+ * The scaled copy, see xCompositeBlt. Only the requests, which end up as
+ * a single destination box, are handled, because the boxes would not be
+ * scaled consistently with each other. The source must not be sampled
+ * outside of its bounds (the edge pixels may be filtered a bit differently
+ * from pixman anyway).
+ */
+static Bool
+xCompositeStretch(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
+                  INT16 xSrc, INT16 ySrc, INT16 xDst, INT16 yDst,
+                  CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PictTransformPtr t = pSrc->transform;
+    RegionRec region;
+    BoxRec box;
+    int src_x1, src_y1, src_x2, src_y2;
+    Bool done;
+    FbBits *src;
+    FbStride srcStride;
+    int srcBpp;
+    int srcXoff, srcYoff;
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int dstXoff, dstYoff;
+
+    if (!private->blt2d_stretch_blt || !pSrc->pDrawable || pSrc->repeat ||
+        pSrc->alphaMap || pDst->alphaMap || pSrc->clientClip)
+        return FALSE;
+    if (t->matrix[0][1] || t->matrix[1][0] || t->matrix[2][0] ||
+        t->matrix[2][1] || t->matrix[2][2] != xFixed1 ||
+        t->matrix[0][0] <= 0 || t->matrix[1][1] <= 0)
+        return FALSE;
+    if (pSrc->filter != PictFilterNearest && pSrc->filter != PictFilterFast &&
+        pSrc->filter != PictFilterBilinear && pSrc->filter != PictFilterGood)
+        return FALSE;
+    if ((pSrc->pDrawable->bitsPerPixel != 16 &&
+         pSrc->pDrawable->bitsPerPixel != 32) ||
+        (pDst->pDrawable->bitsPerPixel != 16 &&
+         pDst->pDrawable->bitsPerPixel != 32))
+        return FALSE;
+    if (xGetDrawablePixmap(pSrc->pDrawable) ==
+        xGetDrawablePixmap(pDst->pDrawable))
+        return FALSE;
+    if (!xCompositeIsCopy(op, pSrc->format, pDst->format))
+        return FALSE;
+
+    box.x1 = xDst + pDst->pDrawable->x;
+    box.y1 = yDst + pDst->pDrawable->y;
+    box.x2 = box.x1 + width;
+    box.y2 = box.y1 + height;
+    RegionInit(&region, &box, 1);
+    RegionIntersect(&region, &region, pDst->pCompositeClip);
+    if (!RegionNotEmpty(&region)) {
+        RegionUninit(&region);
+        return TRUE;
+    }
+    if (RegionNumRects(&region) != 1) {
+        RegionUninit(&region);
+        return FALSE;
+    }
+    box = *RegionExtents(&region);
+    RegionUninit(&region);
+
+    /* Map the destination box edges to the source picture (rounded) */
+    src_x1 = xMapEdge(box.x1 - pDst->pDrawable->x - xDst + xSrc,
+                      t->matrix[0][0], t->matrix[0][2]);
+    src_x2 = xMapEdge(box.x2 - pDst->pDrawable->x - xDst + xSrc,
+                      t->matrix[0][0], t->matrix[0][2]);
+    src_y1 = xMapEdge(box.y1 - pDst->pDrawable->y - yDst + ySrc,
+                      t->matrix[1][1], t->matrix[1][2]);
+    src_y2 = xMapEdge(box.y2 - pDst->pDrawable->y - yDst + ySrc,
+                      t->matrix[1][1], t->matrix[1][2]);
+    if (src_x1 < 0 || src_y1 < 0 || src_x1 >= src_x2 || src_y1 >= src_y2 ||
+        src_x2 > pSrc->pDrawable->width || src_y2 > pSrc->pDrawable->height)
+        return FALSE;
+
+    miCompositeSourceValidate(pSrc);
+
+    fbGetDrawable(pSrc->pDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
+    fbGetDrawable(pDst->pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+
+    done = private->blt2d_stretch_blt(private->blt2d_self,
+                                      (uint32_t *)src, (uint32_t *)dst,
+                                      srcStride, dstStride, srcBpp, dstBpp,
+                                      src_x1 + pSrc->pDrawable->x + srcXoff,
+                                      src_y1 + pSrc->pDrawable->y + srcYoff,
+                                      src_x2 - src_x1, src_y2 - src_y1,
+                                      box.x1 + dstXoff, box.y1 + dstYoff,
+                                      box.x2 - box.x1, box.y2 - box.y1);
+
+    fbFinishAccess(pDst->pDrawable);
+    fbFinishAccess(pSrc->pDrawable);
+    return done;
+}
+
+static void
+xComposite(CARD8 op, PicturePtr pSrc, PicturePtr pMask, PicturePtr pDst,
+           INT16 xSrc, INT16 ySrc, INT16 xMask, INT16 yMask,
+           INT16 xDst, INT16 yDst, CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PictureScreenPtr ps = GetPictureScreen(pScreen);
+
+    if (pSrc->pDrawable)
+        xTouchDrawable(pSrc->pDrawable);
+    xTouchDrawable(pDst->pDrawable);
+
+    if (!pMask && !pSrc->transform &&
+        xCompositeBlt(op, pSrc, pDst, xSrc, ySrc, xDst, yDst, width, height))
+        return;
+    if (!pMask && pSrc->transform &&
+        xCompositeStretch(op, pSrc, pDst, xSrc, ySrc, xDst, yDst,
+                          width, height))
+        return;
+
+    xSyncPicture(pSrc);
+    xSyncPicture(pMask);
+    xSyncPicture(pDst);
+    ps->Composite = private->Composite;
+    (*ps->Composite) (op, pSrc, pMask, pDst, xSrc, ySrc, xMask, yMask,
+                      xDst, yDst, width, height);
+    ps->Composite = xComposite;
+}
+
+static void
+xGlyphs(CARD8 op, PicturePtr pSrc, PicturePtr pDst, PictFormatPtr maskFormat,
+        INT16 xSrc, INT16 ySrc, int nlist, GlyphListPtr list,
+        GlyphPtr *glyphs)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PictureScreenPtr ps = GetPictureScreen(pScreen);
+
+    xSyncPicture(pSrc);
+    xSyncPicture(pDst);
+    ps->Glyphs = private->Glyphs;
+    (*ps->Glyphs) (op, pSrc, pDst, maskFormat, xSrc, ySrc, nlist, list,
+                   glyphs);
+    ps->Glyphs = xGlyphs;
+}
+
+static void
+xTrapezoids(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
+            PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
+            int ntrap, xTrapezoid *traps)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PictureScreenPtr ps = GetPictureScreen(pScreen);
+
+    xSyncPicture(pSrc);
+    xSyncPicture(pDst);
+    ps->Trapezoids = private->Trapezoids;
+    (*ps->Trapezoids) (op, pSrc, pDst, maskFormat, xSrc, ySrc, ntrap, traps);
+    ps->Trapezoids = xTrapezoids;
+}
+
+static void
+xTriangles(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
+           PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
+           int ntri, xTriangle *tris)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PictureScreenPtr ps = GetPictureScreen(pScreen);
+
+    xSyncPicture(pSrc);
+    xSyncPicture(pDst);
+    ps->Triangles = private->Triangles;
+    (*ps->Triangles) (op, pSrc, pDst, maskFormat, xSrc, ySrc, ntri, tris);
+    ps->Triangles = xTriangles;
+}
+
+static void
+xAddTraps(PicturePtr pPicture, INT16 xOff, INT16 yOff, int ntrap,
+          xTrap *traps)
+{
+    ScreenPtr pScreen = pPicture->pDrawable->pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PictureScreenPtr ps = GetPictureScreen(pScreen);
+
+    xSyncPicture(pPicture);
+    ps->AddTraps = private->AddTraps;
+    (*ps->AddTraps) (pPicture, xOff, yOff, ntrap, traps);
+    ps->AddTraps = xAddTraps;
+}
+
+/*****************************************************************************/
+
+/*
+ * The backing pixmaps are copied to the screen all the time, but blt2d can
+ * only accelerate this if they are in the framebuffer too. So allocate them
+ * there if possible. The least recently copied pixmaps are moved to the
+ * system memory when the offscreen memory runs out.
+ */
+
+/* The smaller pixmaps are not worth it (and copied by the CPU anyway) */
+#define OFFSCREEN_PIXMAP_MIN_AREA (64 * 64)
+
+static void
+xEvictPixmap(void *data, void *owner, uint8_t *old_ptr, uint8_t *new_ptr,
+             uint32_t size)
+{
+    SunxiG2D *private = (SunxiG2D *)data;
+    PixmapPtr pPixmap = (PixmapPtr)owner;
+    int stride = pPixmap->devKind / sizeof(uint32_t);
+    int bpp = pPixmap->drawable.bitsPerPixel;
+
+    /* Not used if the pixmap has been migrated to a DRI2 buffer */
+    if (pPixmap->devPrivate.ptr != old_ptr)
+        return;
+
+    xSync(private);
+    /* The CPU backend reads from the framebuffer faster than memcpy */
+    if (!private->blt2d_overlapped_blt(private->blt2d_self,
+                                      (uint32_t *)old_ptr, (uint32_t *)new_ptr,
+                                      stride, stride, bpp, bpp, 0, 0, 0, 0,
+                                      pPixmap->drawable.width,
+                                      pPixmap->drawable.height))
+        memcpy(new_ptr, old_ptr, size);
+    xSync(private);
+
+    pPixmap->devPrivate.ptr = new_ptr;
+}
+
+static PixmapPtr
+xCreatePixmap(ScreenPtr pScreen, int width, int height, int depth,
+              unsigned usage_hint)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    PixmapPtr pPixmap = NULL;
+    int bpp = BitsPerPixel(depth);
+
+    pScreen->CreatePixmap = private->CreatePixmap;
+
+    if (usage_hint == CREATE_PIXMAP_USAGE_BACKING_PIXMAP &&
+        (bpp == 16 || bpp == 32) &&
+        width * height >= OFFSCREEN_PIXMAP_MIN_AREA)
+    {
+        int stride = PixmapBytePad(width, depth);
+        uint8_t *bits = NULL;
+
+        /* Just the header, the pixel data is in the framebuffer */
+        pPixmap = (*pScreen->CreatePixmap) (pScreen, 0, 0, depth, usage_hint);
+        if (pPixmap)
+            bits = offscreen_alloc(private->offscreen, stride * height,
+                                   pPixmap);
+        if (pPixmap && (!bits ||
+                        !pScreen->ModifyPixmapHeader(pPixmap, width, height,
+                                                     depth, bpp, stride,
+                                                     bits))) {
+            pScreen->DestroyPixmap(pPixmap);
+            pPixmap = NULL;
+        }
+    }
+
+    if (!pPixmap)
+        pPixmap = (*pScreen->CreatePixmap) (pScreen, width, height, depth,
+                                            usage_hint);
+
+    pScreen->CreatePixmap = xCreatePixmap;
+    return pPixmap;
+}
+
+static Bool
+xDestroyPixmap(PixmapPtr pPixmap)
+{
+    ScreenPtr pScreen = pPixmap->drawable.pScreen;
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+    Bool result;
+
+    if (pPixmap->refcnt == 1 &&
+        pPixmap->usage_hint == CREATE_PIXMAP_USAGE_BACKING_PIXMAP)
+        offscreen_free(private->offscreen, pPixmap);
+
+    pScreen->DestroyPixmap = private->DestroyPixmap;
+    result = (*pScreen->DestroyPixmap) (pPixmap);
+    pScreen->DestroyPixmap = xDestroyPixmap;
+
+    return result;
+}
+
+Bool SunxiG2D_InitOffscreenPixmaps(ScreenPtr pScreen, uint8_t *base,
+                                   uint32_t size)
+{
+    ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
+    SunxiG2D *private = SUNXI_G2D(pScrn);
+
+    private->offscreen = offscreen_alloc_init(base, size, 64,
+                                              xEvictPixmap, private);
+    if (!private->offscreen)
+        return FALSE;
+
+    /* Wrap the current CreatePixmap and DestroyPixmap functions */
+    private->CreatePixmap = pScreen->CreatePixmap;
+    pScreen->CreatePixmap = xCreatePixmap;
+    private->DestroyPixmap = pScreen->DestroyPixmap;
+    pScreen->DestroyPixmap = xDestroyPixmap;
+
+    return TRUE;
+}
+
+/*****************************************************************************/
+
 SunxiG2D *SunxiG2D_Init(ScreenPtr pScreen, blt2d_i *blt2d)
 {
     ScrnInfoPtr pScrn = xf86Screens[pScreen->myNum];
@@ -340,6 +1693,16 @@ SunxiG2D *SunxiG2D_Init(ScreenPtr pScreen, blt2d_i *blt2d)
     /* Cache the pointers from blt2d_i here */
     private->blt2d_self = blt2d->self;
     private->blt2d_overlapped_blt = blt2d->overlapped_blt;
+    private->blt2d_fill = blt2d->fill;
+    private->blt2d_blt_boxes = blt2d->blt_boxes;
+    private->blt2d_sync = blt2d->sync;
+    private->blt2d_stretch_blt = blt2d->stretch_blt;
+
+    private->fb_start = FBDEVPTR(pScrn)->fbmem;
+    private->fb_size = pScrn->videoRam;
+
+    /* The core text falls back to fb without it */
+    private->glyph_cache = glyph_cache_init(GLYPH_CACHE_SIZE);
 
     /* Wrap the current CopyWindow function */
     private->CopyWindow = pScreen->CopyWindow;
@@ -349,6 +1712,36 @@ SunxiG2D *SunxiG2D_Init(ScreenPtr pScreen, blt2d_i *blt2d)
     private->CreateGC = pScreen->CreateGC;
     pScreen->CreateGC = xCreateGC;
 
+    /* Wrap the current GetImage function */
+    private->GetImage = pScreen->GetImage;
+    pScreen->GetImage = xGetImage;
+
+    /* Wrap the current Composite function */
+    if (GetPictureScreenIfSet(pScreen)) {
+        PictureScreenPtr ps = GetPictureScreen(pScreen);
+        private->Composite = ps->Composite;
+        ps->Composite = xComposite;
+    }
+
+    /* The rest only needs to be wrapped for the asynchronous blt2d */
+    if (private->blt2d_sync) {
+        PictureScreenPtr ps = GetPictureScreenIfSet(pScreen);
+
+        private->GetSpans = pScreen->GetSpans;
+        pScreen->GetSpans = xGetSpans;
+
+        if (ps) {
+            private->Glyphs = ps->Glyphs;
+            ps->Glyphs = xGlyphs;
+            private->Trapezoids = ps->Trapezoids;
+            ps->Trapezoids = xTrapezoids;
+            private->Triangles = ps->Triangles;
+            ps->Triangles = xTriangles;
+            private->AddTraps = ps->AddTraps;
+            ps->AddTraps = xAddTraps;
+        }
+    }
+
     return private;
 }
 
@@ -359,6 +1752,33 @@ void SunxiG2D_Close(ScreenPtr pScreen)
 
     pScreen->CopyWindow = private->CopyWindow;
     pScreen->CreateGC   = private->CreateGC;
+    pScreen->GetImage   = private->GetImage;
+
+    if (GetPictureScreenIfSet(pScreen))
+        GetPictureScreen(pScreen)->Composite = private->Composite;
+
+    if (private->blt2d_sync) {
+        PictureScreenPtr ps = GetPictureScreenIfSet(pScreen);
+
+        pScreen->GetSpans = private->GetSpans;
+
+        if (ps) {
+            ps->Glyphs     = private->Glyphs;
+            ps->Trapezoids = private->Trapezoids;
+            ps->Triangles  = private->Triangles;
+            ps->AddTraps   = private->AddTraps;
+        }
+    }
+
+    if (private->offscreen) {
+        pScreen->CreatePixmap  = private->CreatePixmap;
+        pScreen->DestroyPixmap = private->DestroyPixmap;
+        offscreen_alloc_close(private->offscreen);
+    }
+
+    if (private->glyph_cache)
+        glyph_cache_close(private->glyph_cache);
+    free(private->glyph_run);
 
     if (private->pGCOps) {
         free(private->pGCOps);
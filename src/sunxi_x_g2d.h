@@ -24,13 +24,41 @@
 #ifndef SUNXI_X_G2D_H
 #define SUNXI_X_G2D_H
 
+#include "picturestr.h"
+
 #include "interfaces.h"
+#include "offscreen_alloc.h"
+#include "glyph_cache.h"
 
 typedef struct {
     GCOps                  *pGCOps;
+    /* The original fb GC operations, which are wrapped by pGCOps */
+    const GCOps            *pFbGCOps;
 
     CopyWindowProcPtr       CopyWindow;
     CreateGCProcPtr         CreateGC;
+    GetImageProcPtr         GetImage;
+    GetSpansProcPtr         GetSpans;
+
+    CompositeProcPtr        Composite;
+    GlyphsProcPtr           Glyphs;
+    TrapezoidsProcPtr       Trapezoids;
+    TrianglesProcPtr        Triangles;
+    AddTrapsProcPtr         AddTraps;
+
+    /* The unfinished blt2d operations may only access this memory */
+    uint8_t                *fb_start;
+    size_t                  fb_size;
+
+    /* The expanded core font glyphs and the buffer for an ImageText run */
+    glyph_cache_t          *glyph_cache;
+    uint8_t                *glyph_run;
+    int                     glyph_run_size;
+
+    /* Optional placement of pixmaps in the spare framebuffer memory */
+    offscreen_alloc_t      *offscreen;
+    CreatePixmapProcPtr     CreatePixmap;
+    DestroyPixmapProcPtr    DestroyPixmap;
 
     /* SunxiG2D_Init copies these pointers here from blt2d_i struct */
     void *blt2d_self;
@@ -47,9 +75,65 @@ typedef struct {
                                 int       dst_y,
                                 int       w,
                                 int       h);
+    int (*blt2d_fill)(void     *self,
+                      uint32_t *bits,
+                      int       stride,
+                      int       bpp,
+                      int       x,
+                      int       y,
+                      int       w,
+                      int       h,
+                      uint32_t  filler);
+    int (*blt2d_blt_boxes)(void              *self,
+                           uint32_t          *src_bits,
+                           uint32_t          *dst_bits,
+                           int                src_stride,
+                           int                dst_stride,
+                           int                src_bpp,
+                           int                dst_bpp,
+                           const blt2d_box_t *boxes,
+                           int                nboxes,
+                           int                src_dx,
+                           int                src_dy,
+                           int                dst_dx,
+                           int                dst_dy);
+    void (*blt2d_sync)(void *self);
+    int (*blt2d_stretch_blt)(void     *self,
+                             uint32_t *src_bits,
+                             uint32_t *dst_bits,
+                             int       src_stride,
+                             int       dst_stride,
+                             int       src_bpp,
+                             int       dst_bpp,
+                             int       src_x,
+                             int       src_y,
+                             int       src_w,
+                             int       src_h,
+                             int       dst_x,
+                             int       dst_y,
+                             int       dst_w,
+                             int       dst_h);
 } SunxiG2D;
 
 SunxiG2D *SunxiG2D_Init(ScreenPtr pScreen, blt2d_i *blt2d);
 void SunxiG2D_Close(ScreenPtr pScreen);
 
+/*
+ * Allocate the backing pixmaps (used for the redirected windows and backing
+ * store) in 'size' bytes of the spare framebuffer memory at 'base', so that
+ * they can be copied to the screen by blt2d.
+ */
+Bool SunxiG2D_InitOffscreenPixmaps(ScreenPtr pScreen, uint8_t *base,
+                                   uint32_t size);
+
+/*
+ * Wait until the blt2d operations are finished (needed if the CPU accesses
+ * the framebuffer outside of the wrapped X server functions).
+ */
+static inline void SunxiG2D_Sync(SunxiG2D *private)
+{
+    if (private && private->blt2d_sync)
+        private->blt2d_sync(private->blt2d_self);
+}
+
 #endif
@@ -0,0 +1,180 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include "worker_pool.h"
+
+struct worker_pool_t {
+    pthread_mutex_t   lock;
+    /* Signalled when a new batch of jobs is submitted or on shutdown */
+    pthread_cond_t    work_cond;
+    /* Signalled when the last job of the current batch is finished */
+    pthread_cond_t    done_cond;
+    pthread_t        *threads;
+    int               nthreads;
+    int               shutdown;
+    /* The current batch of jobs */
+    unsigned          generation;
+    void            (*fn)(void *arg, int job);
+    void             *arg;
+    int               njobs;
+    int               next_job;
+    int               unfinished_jobs;
+};
+
+/*
+ * Grab and execute the jobs from the current batch until there are no
+ * more left. Must be called with the lock held.
+ */
+static void
+process_jobs(worker_pool_t *pool)
+{
+    while (pool->next_job < pool->njobs) {
+        int job = pool->next_job++;
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->arg, job);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->unfinished_jobs == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+}
+
+static void *
+worker_thread(void *arg)
+{
+    worker_pool_t *pool = (worker_pool_t *)arg;
+    unsigned generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->shutdown && pool->generation == generation)
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        if (pool->shutdown)
+            break;
+        generation = pool->generation;
+        process_jobs(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int fbturbo_thread_create(pthread_t *thread,
+                          void *(*fn)(void *arg), void *arg)
+{
+    sigset_t all_signals, old_signals;
+    int err;
+
+    /* The signals must be still delivered to the main thread of X server */
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    err = pthread_create(thread, NULL, fn, arg);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    return err;
+}
+
+worker_pool_t *worker_pool_init(int nthreads)
+{
+    worker_pool_t *pool;
+    int i;
+
+    if (nthreads < 2)
+        return NULL;
+
+    pool = calloc(sizeof(worker_pool_t), 1);
+    if (!pool)
+        return NULL;
+    pool->threads = calloc(sizeof(pthread_t), nthreads - 1);
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (i = 0; i < nthreads - 1; i++) {
+        if (fbturbo_thread_create(&pool->threads[i], worker_thread, pool) != 0)
+            break;
+        pool->nthreads++;
+    }
+
+    if (pool->nthreads == 0) {
+        worker_pool_close(pool);
+        return NULL;
+    }
+    /* Also count the caller */
+    pool->nthreads++;
+    return pool;
+}
+
+void worker_pool_close(worker_pool_t *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads - 1; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+int worker_pool_nthreads(worker_pool_t *pool)
+{
+    return pool->nthreads;
+}
+
+void worker_pool_run(worker_pool_t *pool, int njobs,
+                     void (*fn)(void *arg, int job), void *arg)
+{
+    if (njobs <= 1) {
+        if (njobs == 1)
+            fn(arg, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn              = fn;
+    pool->arg             = arg;
+    pool->njobs           = njobs;
+    pool->next_job        = 0;
+    pool->unfinished_jobs = njobs;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_cond);
+
+    process_jobs(pool);
+    while (pool->unfinished_jobs > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+
+/*
+ * A small pool of persistent worker threads for splitting expensive
+ * operations into independent jobs. The threads are sleeping when
+ * there is no work for them.
+ */
+typedef struct worker_pool_t worker_pool_t;
+
+/*
+ * Create a pool, which executes jobs using 'nthreads' threads in total
+ * (the thread calling worker_pool_run is also counted). Returns NULL if
+ * 'nthreads' is less than 2 or the threads can't be created.
+ */
+worker_pool_t *worker_pool_init(int nthreads);
+void worker_pool_close(worker_pool_t *pool);
+
+/* The total number of threads, including the calling thread */
+int worker_pool_nthreads(worker_pool_t *pool);
+
+/*
+ * Call 'fn(arg, job)' for every 'job' from 0 to 'njobs - 1' using all the
+ * threads of the pool and return when all of them are done. The jobs may
+ * run in any order and in parallel with each other.
+ */
+void worker_pool_run(worker_pool_t *pool, int njobs,
+                     void (*fn)(void *arg, int job), void *arg);
+
+/*
+ * The same as pthread_create with the default attributes, but the new
+ * thread starts with all the signals blocked, so that they are still
+ * delivered to the main thread of X server. This is used for all the
+ * helper threads of the driver. Returns 0 on success.
+ */
+int fbturbo_thread_create(pthread_t *thread,
+                          void *(*fn)(void *arg), void *arg);
+
+#endif
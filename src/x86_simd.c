@@ -0,0 +1,263 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "x86_simd.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+/*
+ * aligned_fetch_fbmem_to_scratch_*(int numbytes, void *scratch, void *fbmem)
+ *
+ * Both 'scratch' and 'fbmem' pointers must be 32 bytes aligned.
+ * The value in 'numbytes' is also rounded up to a multiple of 32 bytes.
+ *
+ * Same as for the ARM code, the purpose is to do the largest possible
+ * perfectly aligned reads from uncached (or write-combining) memory into
+ * a temporary scratch buffer in L1 cache.
+ */
+
+__attribute__((target("sse2"))) void
+aligned_fetch_fbmem_to_scratch_sse2(int size, void *dst, const void *src)
+{
+    __m128i *d = (__m128i *)dst;
+    const __m128i *s = (const __m128i *)src;
+    __m128i x0, x1, x2, x3;
+
+    for (; size >= 64; size -= 64) {
+        x0 = _mm_load_si128(s + 0);
+        x1 = _mm_load_si128(s + 1);
+        x2 = _mm_load_si128(s + 2);
+        x3 = _mm_load_si128(s + 3);
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x1);
+        _mm_store_si128(d + 2, x2);
+        _mm_store_si128(d + 3, x3);
+        s += 4;
+        d += 4;
+    }
+    for (; size > 0; size -= 32) {
+        x0 = _mm_load_si128(s + 0);
+        x1 = _mm_load_si128(s + 1);
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x1);
+        s += 2;
+        d += 2;
+    }
+}
+
+__attribute__((target("sse4.1"))) void
+aligned_fetch_fbmem_to_scratch_sse41(int size, void *dst, const void *src)
+{
+    __m128i *d = (__m128i *)dst;
+    __m128i *s = (__m128i *)src;
+    __m128i x0, x1, x2, x3;
+
+    for (; size >= 64; size -= 64) {
+        x0 = _mm_stream_load_si128(s + 0);
+        x1 = _mm_stream_load_si128(s + 1);
+        x2 = _mm_stream_load_si128(s + 2);
+        x3 = _mm_stream_load_si128(s + 3);
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x1);
+        _mm_store_si128(d + 2, x2);
+        _mm_store_si128(d + 3, x3);
+        s += 4;
+        d += 4;
+    }
+    for (; size > 0; size -= 32) {
+        x0 = _mm_stream_load_si128(s + 0);
+        x1 = _mm_stream_load_si128(s + 1);
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x1);
+        s += 2;
+        d += 2;
+    }
+}
+
+__attribute__((target("avx2"))) void
+aligned_fetch_fbmem_to_scratch_avx2(int size, void *dst, const void *src)
+{
+    __m256i *d = (__m256i *)dst;
+    __m256i *s = (__m256i *)src;
+    __m256i y0, y1, y2, y3;
+
+    for (; size >= 128; size -= 128) {
+        y0 = _mm256_stream_load_si256(s + 0);
+        y1 = _mm256_stream_load_si256(s + 1);
+        y2 = _mm256_stream_load_si256(s + 2);
+        y3 = _mm256_stream_load_si256(s + 3);
+        _mm256_store_si256(d + 0, y0);
+        _mm256_store_si256(d + 1, y1);
+        _mm256_store_si256(d + 2, y2);
+        _mm256_store_si256(d + 3, y3);
+        s += 4;
+        d += 4;
+    }
+    for (; size > 0; size -= 32) {
+        y0 = _mm256_stream_load_si256(s);
+        _mm256_store_si256(d, y0);
+        s += 1;
+        d += 1;
+    }
+}
+
+/*
+ * writeback_scratch_to_mem_*(int numbytes, void *dst, void *src)
+ *
+ * Copy a chunk of data from a cached scratch buffer to a memory buffer
+ * in forward direction. The destination pointer is aligned first, so
+ * that the bulk of the stores to the (likely write-combining) destination
+ * are naturally aligned. The final SFENCE flushes the write-combining
+ * buffers, so that the data is visible to the subsequent uncached reads
+ * (the source and destination may overlap).
+ */
+
+__attribute__((target("sse2"))) void
+writeback_scratch_to_mem_sse2(int size, void *dst, const void *src)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    __m128i x0, x1, x2, x3;
+
+    if (size >= 32) {
+        int head = (int)(-(uintptr_t)d & 15);
+        memcpy(d, s, head);
+        d += head;
+        s += head;
+        size -= head;
+        for (; size >= 64; size -= 64) {
+            x0 = _mm_loadu_si128((const __m128i *)s + 0);
+            x1 = _mm_loadu_si128((const __m128i *)s + 1);
+            x2 = _mm_loadu_si128((const __m128i *)s + 2);
+            x3 = _mm_loadu_si128((const __m128i *)s + 3);
+            _mm_store_si128((__m128i *)d + 0, x0);
+            _mm_store_si128((__m128i *)d + 1, x1);
+            _mm_store_si128((__m128i *)d + 2, x2);
+            _mm_store_si128((__m128i *)d + 3, x3);
+            s += 64;
+            d += 64;
+        }
+        for (; size >= 16; size -= 16) {
+            x0 = _mm_loadu_si128((const __m128i *)s);
+            _mm_store_si128((__m128i *)d, x0);
+            s += 16;
+            d += 16;
+        }
+    }
+    memcpy(d, s, size);
+    _mm_sfence();
+}
+
+__attribute__((target("avx2"))) void
+writeback_scratch_to_mem_avx2(int size, void *dst, const void *src)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    __m256i y0, y1;
+    __m128i x0;
+
+    if (size >= 64) {
+        int head = (int)(-(uintptr_t)d & 31);
+        memcpy(d, s, head);
+        d += head;
+        s += head;
+        size -= head;
+        for (; size >= 64; size -= 64) {
+            y0 = _mm256_loadu_si256((const __m256i *)s + 0);
+            y1 = _mm256_loadu_si256((const __m256i *)s + 1);
+            _mm256_store_si256((__m256i *)d + 0, y0);
+            _mm256_store_si256((__m256i *)d + 1, y1);
+            s += 64;
+            d += 64;
+        }
+        if (size >= 32) {
+            y0 = _mm256_loadu_si256((const __m256i *)s);
+            _mm256_store_si256((__m256i *)d, y0);
+            s += 32;
+            d += 32;
+            size -= 32;
+        }
+        if (size >= 16) {
+            x0 = _mm_loadu_si128((const __m128i *)s);
+            _mm_store_si128((__m128i *)d, x0);
+            s += 16;
+            d += 16;
+            size -= 16;
+        }
+    }
+    memcpy(d, s, size);
+    _mm_sfence();
+}
+
+/*
+ * aligned_fill_fbmem_*(int numbytes, void *dst, uint32_t pattern)
+ *
+ * Fill a 32 bytes aligned buffer (framebuffer) with a 32-bit pattern. The
+ * size must be a multiple of 32. Only full 32 byte aligned chunks are
+ * written, which is the best case for the write-combining buffers.
+ */
+
+__attribute__((target("sse2"))) void
+aligned_fill_fbmem_sse2(int size, void *dst, uint32_t pattern)
+{
+    __m128i *d = (__m128i *)dst;
+    __m128i x0 = _mm_set1_epi32((int)pattern);
+
+    for (; size >= 64; size -= 64) {
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x0);
+        _mm_store_si128(d + 2, x0);
+        _mm_store_si128(d + 3, x0);
+        d += 4;
+    }
+    if (size > 0) {
+        _mm_store_si128(d + 0, x0);
+        _mm_store_si128(d + 1, x0);
+    }
+    _mm_sfence();
+}
+
+__attribute__((target("avx2"))) void
+aligned_fill_fbmem_avx2(int size, void *dst, uint32_t pattern)
+{
+    __m256i *d = (__m256i *)dst;
+    __m256i y0 = _mm256_set1_epi32((int)pattern);
+
+    for (; size >= 128; size -= 128) {
+        _mm256_store_si256(d + 0, y0);
+        _mm256_store_si256(d + 1, y0);
+        _mm256_store_si256(d + 2, y0);
+        _mm256_store_si256(d + 3, y0);
+        d += 4;
+    }
+    for (; size > 0; size -= 32)
+        _mm256_store_si256(d++, y0);
+    _mm_sfence();
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef X86_SIMD_H
+#define X86_SIMD_H
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <stdint.h>
+
+/*
+ * x86 counterparts of the ARM assembly functions from "arm_asm.S", which are
+ * used by the CPU backend. The SSE4.1 and AVX2 fetch variants use MOVNTDQA
+ * non-temporal loads, which are intended for reading from write-combining
+ * memory (such as the framebuffer).
+ */
+
+void aligned_fetch_fbmem_to_scratch_sse2(int size, void *dst, const void *src);
+void aligned_fetch_fbmem_to_scratch_sse41(int size, void *dst, const void *src);
+void aligned_fetch_fbmem_to_scratch_avx2(int size, void *dst, const void *src);
+
+void writeback_scratch_to_mem_sse2(int size, void *dst, const void *src);
+void writeback_scratch_to_mem_avx2(int size, void *dst, const void *src);
+
+void aligned_fill_fbmem_sse2(int size, void *dst, uint32_t pattern);
+void aligned_fill_fbmem_avx2(int size, void *dst, uint32_t pattern);
+
+#endif
+
+#endif
@@ -0,0 +1,415 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A micro-benchmark for the blt2d_i implementations (cpu_backend,
+ * fb_copyarea and sunxi G2D), which are driven directly without
+ * the X server. The operations are run over a matrix of widths,
+ * heights, alignments, overlap directions and color depths, the
+ * results are reported in CSV or JSON format:
+ *
+ *     memory,backend,op,bpp,width,height,align,overlap,iterations,
+ *     mpix_per_sec,p50_us,p90_us,p99_us
+ *
+ * The memory used for the tests can be one of:
+ *     fb    - mmap'ed framebuffer device (its contents get trashed!)
+ *     memfd - shared memory from memfd_create
+ *     anon  - anonymous private mapping
+ *
+ * Only the cpu backend can work with the non-framebuffer memory, it
+ * treats the whole buffer as if it was an uncached framebuffer.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+#include <time.h>
+
+#include "../src/cpu_backend.h"
+#include "../src/fb_copyarea.h"
+#include "../src/sunxi_disp.h"
+
+/* The geometry of the non-framebuffer test buffers (in 32-bit words) */
+#define BUFFER_STRIDE   2048
+#define BUFFER_HEIGHT   1200
+
+/* Distance between the source and destination for the overlapped copies */
+#define OVERLAP_SHIFT   8
+
+/* Each test runs at least MIN_ITERATIONS times and at least MIN_TIME */
+#define MIN_ITERATIONS  10
+#define MIN_TIME        0.02
+
+static const int widths[]  = { 8, 64, 256, 1024, 1920 };
+static const int heights[] = { 1, 16, 256 };
+static const int aligns[]  = { 0, 1, 7 };
+static const int bpps[]    = { 16, 32 };
+
+enum { OVERLAP_NONE, OVERLAP_UP, OVERLAP_DOWN, OVERLAP_LEFT, OVERLAP_RIGHT };
+static const char *overlap_names[] = { "none", "up", "down", "left", "right" };
+
+#define ARRAY_SIZE(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+typedef struct {
+    const char *name;
+    blt2d_i    *blt2d;
+} backend_t;
+
+typedef struct {
+    const char *memory;
+    const char *backend;
+    const char *op;
+    int         bpp, width, height, align, overlap;
+    int         iterations;
+    double      mpix_per_sec;
+    double      p50, p90, p99;
+} result_t;
+
+static int json_output;
+static int results_count;
+static int max_iterations = 1000;
+
+double gettime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, int p)
+{
+    int idx = (n * p + 99) / 100 - 1;
+    if (idx < 0)
+        idx = 0;
+    if (idx >= n)
+        idx = n - 1;
+    return sorted[idx];
+}
+
+static void print_result(const result_t *r)
+{
+    if (json_output) {
+        printf("%s  {\"memory\": \"%s\", \"backend\": \"%s\", \"op\": \"%s\", "
+               "\"bpp\": %d, \"width\": %d, \"height\": %d, \"align\": %d, "
+               "\"overlap\": \"%s\", \"iterations\": %d, "
+               "\"mpix_per_sec\": %.2f, \"p50_us\": %.2f, "
+               "\"p90_us\": %.2f, \"p99_us\": %.2f}",
+               results_count ? ",\n" : "",
+               r->memory, r->backend, r->op, r->bpp, r->width, r->height,
+               r->align, overlap_names[r->overlap], r->iterations,
+               r->mpix_per_sec, r->p50, r->p90, r->p99);
+    }
+    else {
+        printf("%s,%s,%s,%d,%d,%d,%d,%s,%d,%.2f,%.2f,%.2f,%.2f\n",
+               r->memory, r->backend, r->op, r->bpp, r->width, r->height,
+               r->align, overlap_names[r->overlap], r->iterations,
+               r->mpix_per_sec, r->p50, r->p90, r->p99);
+    }
+    fflush(stdout);
+    results_count++;
+}
+
+/*
+ * Run a single test case. The 'fill' operation ignores the source
+ * coordinates and fills the destination rectangle.
+ */
+static void run_test(result_t *r, blt2d_i *blt2d, uint32_t *bits,
+                     int stride, int is_fill,
+                     int src_x, int src_y, int dst_x, int dst_y,
+                     double *latencies)
+{
+    double t_start, t1, t2, total = 0;
+    int i, n = 0;
+
+    t_start = gettime();
+    do {
+        t1 = gettime();
+        if (is_fill) {
+            blt2d->fill(blt2d->self, bits, stride, r->bpp,
+                        dst_x, dst_y, r->width, r->height, 0x5A5A5A5A + n);
+        }
+        else {
+            blt2d->overlapped_blt(blt2d->self, bits, bits, stride, stride,
+                                  r->bpp, r->bpp, src_x, src_y, dst_x, dst_y,
+                                  r->width, r->height);
+        }
+        t2 = gettime();
+        latencies[n++] = (t2 - t1) * 1000000.;
+    } while (n < max_iterations &&
+             (n < MIN_ITERATIONS || t2 - t_start < MIN_TIME));
+
+    for (i = 0; i < n; i++)
+        total += latencies[i];
+    qsort(latencies, n, sizeof(double), compare_doubles);
+
+    r->iterations = n;
+    r->mpix_per_sec = (double)r->width * r->height * n / total;
+    r->p50 = percentile(latencies, n, 50);
+    r->p90 = percentile(latencies, n, 90);
+    r->p99 = percentile(latencies, n, 99);
+}
+
+static void run_backend(const char *memory, backend_t *backend,
+                        uint32_t *bits, int stride, int height)
+{
+    double *latencies = malloc(max_iterations * sizeof(double));
+    int ib, iw, ih, ia, ov, is_fill;
+    result_t r;
+
+    if (!latencies)
+        return;
+
+    for (ib = 0; ib < ARRAY_SIZE(bpps); ib++)
+    for (is_fill = 0; is_fill <= 1; is_fill++)
+    for (ov = OVERLAP_NONE; ov <= OVERLAP_RIGHT; ov++)
+    for (ih = 0; ih < ARRAY_SIZE(heights); ih++)
+    for (iw = 0; iw < ARRAY_SIZE(widths); iw++)
+    for (ia = 0; ia < ARRAY_SIZE(aligns); ia++) {
+        int bpp = bpps[ib];
+        int stride_pixels = stride * 32 / bpp;
+        int w = widths[iw], h = heights[ih], a = aligns[ia];
+        int src_x = a, src_y = 0, dst_x = 0, dst_y = 0;
+
+        /* overlap direction is meaningless for fills */
+        if (is_fill && ov != OVERLAP_NONE)
+            continue;
+
+        if (w + a + OVERLAP_SHIFT > stride_pixels ||
+            2 * h + OVERLAP_SHIFT > height)
+            continue;
+
+        switch (ov) {
+        case OVERLAP_NONE:
+            dst_y = height - h;
+            break;
+        case OVERLAP_UP:
+            src_y = OVERLAP_SHIFT;
+            break;
+        case OVERLAP_DOWN:
+            dst_y = OVERLAP_SHIFT;
+            break;
+        case OVERLAP_LEFT:
+            src_x += OVERLAP_SHIFT;
+            break;
+        case OVERLAP_RIGHT:
+            dst_x = OVERLAP_SHIFT;
+            break;
+        }
+        if (is_fill)
+            dst_x = a;
+
+        memset(&r, 0, sizeof(r));
+        r.memory  = memory;
+        r.backend = backend->name;
+        r.op      = is_fill ? "fill" : "blt";
+        r.bpp     = bpp;
+        r.width   = w;
+        r.height  = h;
+        r.align   = a;
+        r.overlap = ov;
+        run_test(&r, backend->blt2d, bits, stride, is_fill,
+                 src_x, src_y, dst_x, dst_y, latencies);
+        print_result(&r);
+    }
+
+    free(latencies);
+}
+
+static void usage(const char *progname)
+{
+    printf("Usage: %s [options]\n", progname);
+    printf("  -m fb|memfd|anon  memory used for the tests (default: anon)\n");
+    printf("  -d device         framebuffer device (default: /dev/fb0)\n");
+    printf("  -b backend        cpu, copyarea, g2d or all (default: all)\n");
+    printf("  -n iterations     maximal number of iterations per test\n");
+    printf("  -j                report results in JSON instead of CSV\n");
+    printf("\n");
+    printf("WARNING: '-m fb' overwrites the framebuffer contents\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *memory = "anon";
+    const char *device = "/dev/fb0";
+    const char *backend_name = "all";
+    uint32_t *bits;
+    size_t size;
+    int stride = BUFFER_STRIDE, height = BUFFER_HEIGHT;
+    int fd = -1, opt, i, nbackends = 0;
+    cpu_backend_t *cpu_backend;
+    fb_copyarea_t *fb_copyarea = NULL;
+    sunxi_disp_t *disp = NULL;
+    backend_t backends[3];
+
+    while ((opt = getopt(argc, argv, "m:d:b:n:jh")) != -1) {
+        switch (opt) {
+        case 'm':
+            memory = optarg;
+            break;
+        case 'd':
+            device = optarg;
+            break;
+        case 'b':
+            backend_name = optarg;
+            break;
+        case 'n':
+            max_iterations = atoi(optarg);
+            if (max_iterations < MIN_ITERATIONS)
+                max_iterations = MIN_ITERATIONS;
+            break;
+        case 'j':
+            json_output = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (strcmp(memory, "fb") == 0) {
+        struct fb_fix_screeninfo fsi;
+        struct fb_var_screeninfo vsi;
+        fd = open(device, O_RDWR);
+        if (fd < 0 || ioctl(fd, FBIOGET_FSCREENINFO, &fsi) < 0 ||
+                      ioctl(fd, FBIOGET_VSCREENINFO, &vsi) < 0) {
+            fprintf(stderr, "can't open framebuffer device '%s'\n", device);
+            return 1;
+        }
+        stride = fsi.line_length / 4;
+        height = fsi.smem_len / fsi.line_length;
+        size = fsi.smem_len;
+        bits = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        fprintf(stderr, "%s: %dx%d, %d bpp, line_length %d, %d lines\n",
+                device, vsi.xres, vsi.yres, vsi.bits_per_pixel,
+                fsi.line_length, height);
+    }
+    else if (strcmp(memory, "memfd") == 0) {
+        size = (size_t)stride * height * 4;
+#ifdef SYS_memfd_create
+        fd = syscall(SYS_memfd_create, "blt_bench", 0);
+#endif
+        if (fd < 0 || ftruncate(fd, size) < 0) {
+            fprintf(stderr, "memfd_create failed\n");
+            return 1;
+        }
+        bits = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    else if (strcmp(memory, "anon") == 0) {
+        size = (size_t)stride * height * 4;
+        bits = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (bits == MAP_FAILED) {
+        fprintf(stderr, "mmap failed\n");
+        return 1;
+    }
+    memset(bits, 0x55, size);
+
+    cpu_backend = cpu_backend_init((uint8_t *)bits, size);
+    if (!cpu_backend) {
+        fprintf(stderr, "cpu_backend_init failed\n");
+        return 1;
+    }
+
+    if (strcmp(backend_name, "all") == 0 || strcmp(backend_name, "cpu") == 0) {
+        backends[nbackends].name = "cpu";
+        backends[nbackends++].blt2d = &cpu_backend->blt2d;
+    }
+
+    /* These need a real framebuffer and fall back to cpu_backend */
+    if (strcmp(memory, "fb") == 0 &&
+        (strcmp(backend_name, "all") == 0 ||
+         strcmp(backend_name, "copyarea") == 0)) {
+        fb_copyarea = fb_copyarea_init(device, bits);
+        if (fb_copyarea) {
+            fb_copyarea->fallback_blt2d = &cpu_backend->blt2d;
+            backends[nbackends].name = "copyarea";
+            backends[nbackends++].blt2d = &fb_copyarea->blt2d;
+        }
+        else {
+            fprintf(stderr, "copyarea ioctl is not supported\n");
+        }
+    }
+
+    if (strcmp(memory, "fb") == 0 &&
+        (strcmp(backend_name, "all") == 0 ||
+         strcmp(backend_name, "g2d") == 0)) {
+        disp = sunxi_disp_init(device, bits);
+        if (disp && disp->fd_g2d >= 0) {
+            disp->fallback_blt2d = &cpu_backend->blt2d;
+            backends[nbackends].name = "g2d";
+            backends[nbackends++].blt2d = &disp->blt2d;
+        }
+        else {
+            fprintf(stderr, "sunxi G2D is not available\n");
+        }
+    }
+
+    if (nbackends == 0) {
+        fprintf(stderr, "no usable backends for '%s' memory\n", memory);
+        return 1;
+    }
+
+    fprintf(stderr, "cpu backend: %s\n", cpu_backend->blt2d_name);
+
+    if (json_output)
+        printf("[\n");
+    else
+        printf("memory,backend,op,bpp,width,height,align,overlap,iterations,"
+               "mpix_per_sec,p50_us,p90_us,p99_us\n");
+
+    for (i = 0; i < nbackends; i++)
+        run_backend(memory, &backends[i], bits, stride, height);
+
+    if (json_output)
+        printf("\n]\n");
+
+    if (disp)
+        sunxi_disp_close(disp);
+    if (fb_copyarea)
+        fb_copyarea_close(fb_copyarea);
+    cpu_backend_close(cpu_backend);
+    munmap(bits, size);
+    if (fd >= 0)
+        close(fd);
+
+    return 0;
+}
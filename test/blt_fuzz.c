@@ -0,0 +1,794 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A differential fuzzing test for the blt2d_i implementation of cpu_backend.
+ * Random (and often overlapping) copies inside of a single buffer, also
+ * split into boxes for blt_boxes, solid fills and the r5g6b5 <-> a8r8g8b8
+ * converting copies to/from a buffer in the cached memory are done by every
+ * fetch/writeback kernel compiled in for this CPU, both with and without
+ * splitting work between threads. After each operation, the whole buffer
+ * is compared with the result of a simple reference implementation, which
+ * uses memmove for each row or handles one pixel at a time. The screen
+ * rotation (cpu_backend_rotated_blt) and the 32bpp to 16bpp conversion
+ * of the shadow framebuffer updates are checked in the same way against
+ * the references, which handle one pixel at a time.
+ *
+ * The buffer is surrounded by inaccessible guard pages, so reading or
+ * writing outside of the page aligned framebuffer-alike area crashes
+ * the test.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "../src/cpu_backend.h"
+
+/* The buffer geometry (stride is in 32-bit words) */
+#define STRIDE  1024
+#define HEIGHT  128
+
+static uint32_t rand_state;
+
+static uint32_t lcg_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+static int rand_range(int n)
+{
+    return n > 0 ? lcg_rand() % n : 0;
+}
+
+double gettime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.;
+}
+
+/* The same 4x4 ordered dithering as in cpu_backend */
+static const uint8_t dither_matrix_4x4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+static uint16_t reference_8888_to_0565(uint32_t p, int rb_dither, int g_dither)
+{
+    int r = ((p >> 16) & 0xFF) + rb_dither;
+    int g = ((p >> 8) & 0xFF) + g_dither;
+    int b = (p & 0xFF) + rb_dither;
+    r = r > 0xFF ? 0xFF : r;
+    g = g > 0xFF ? 0xFF : g;
+    b = b > 0xFF ? 0xFF : b;
+    return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+static uint32_t reference_0565_to_8888(uint16_t p)
+{
+    uint32_t r = (p >> 11) & 0x1F;
+    uint32_t g = (p >> 5) & 0x3F;
+    uint32_t b = p & 0x1F;
+    return 0xFF000000 | (((r << 3) | (r >> 2)) << 16) |
+           (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+}
+
+/* The operations of blt2d_i, which are checked by fuzz_blt2d */
+enum {
+    OP_OVERLAPPED_BLT,
+    OP_BLT_BOXES,
+    OP_FILL,
+    OP_CONVERT,
+    OP_KINDS
+};
+
+static const char *op_names[OP_KINDS] = {
+    "overlapped_blt", "blt_boxes", "fill", "convert"
+};
+
+/* The maximal number of boxes in a blt_boxes operation */
+#define MAX_BOXES 16
+
+typedef struct {
+    int kind;
+    int bpp, dst_bpp;
+    int src_x, src_y, dst_x, dst_y;
+    int w, h;
+    /* The pixel value for OP_FILL */
+    uint32_t filler;
+    /* OP_CONVERT: copy from the framebuffer to the cached memory */
+    int to_cached;
+    /* OP_CONVERT: dither the 32bpp to 16bpp conversion */
+    int dither;
+    /* OP_BLT_BOXES and sometimes OP_CONVERT: split the rectangle into
+     * boxes (in the destination coordinates) and use blt_boxes */
+    int nboxes;
+    blt2d_box_t boxes[MAX_BOXES];
+} blt_op_t;
+
+/*
+ * Generate a random rectangle for the operation, preferring small sizes,
+ * overlapping source and destination and the areas touching the buffer
+ * edges. The 'bpp' is picked randomly if it is 0.
+ */
+static void random_rect(blt_op_t *op, int bpp)
+{
+    static const int bpps[] = { 8, 16, 32 };
+    int stride_pixels, kind;
+
+    op->bpp = bpp ? bpp : bpps[rand_range(3)];
+    stride_pixels = STRIDE * 32 / op->bpp;
+
+    switch (rand_range(4)) {
+    case 0:
+        op->w = 1 + rand_range(16);
+        break;
+    case 1:
+        op->w = 1 + rand_range(128);
+        break;
+    default:
+        op->w = 1 + rand_range(stride_pixels);
+        break;
+    }
+    op->h = rand_range(2) ? 1 + rand_range(8) : 1 + rand_range(HEIGHT);
+
+    op->src_x = rand_range(stride_pixels - op->w + 1);
+    op->src_y = rand_range(HEIGHT - op->h + 1);
+
+    kind = rand_range(8);
+    if (kind < 4) {
+        /* A small shift, like scrolling or dragging a window */
+        op->dst_x = op->src_x + rand_range(81) - 40;
+        op->dst_y = op->src_y + rand_range(7) - 3;
+    }
+    else if (kind < 6) {
+        op->dst_x = rand_range(stride_pixels - op->w + 1);
+        op->dst_y = rand_range(HEIGHT - op->h + 1);
+    }
+    else {
+        /* Touch the first or the last byte of the buffer */
+        if (rand_range(2)) {
+            op->src_x = op->src_y = 0;
+            op->dst_x = stride_pixels - op->w;
+            op->dst_y = HEIGHT - op->h;
+        }
+        else {
+            op->dst_x = op->dst_y = 0;
+            op->src_x = stride_pixels - op->w;
+            op->src_y = HEIGHT - op->h;
+        }
+        if (kind == 7) {
+            blt_op_t tmp = *op;
+            op->src_x = tmp.dst_x;
+            op->src_y = tmp.dst_y;
+            op->dst_x = tmp.src_x;
+            op->dst_y = tmp.src_y;
+        }
+    }
+
+    if (op->dst_x < 0)
+        op->dst_x = 0;
+    if (op->dst_x > stride_pixels - op->w)
+        op->dst_x = stride_pixels - op->w;
+    if (op->dst_y < 0)
+        op->dst_y = 0;
+    if (op->dst_y > HEIGHT - op->h)
+        op->dst_y = HEIGHT - op->h;
+}
+
+static void reference_blt(uint8_t *buf, const blt_op_t *op)
+{
+    int bytespp = op->bpp / 8;
+    int row_bytes = op->w * bytespp;
+    int y;
+
+    /* Process the rows in the order, which doesn't clobber the source */
+    for (y = 0; y < op->h; y++) {
+        int row = op->dst_y > op->src_y ? op->h - 1 - y : y;
+        memmove(buf + (op->dst_y + row) * STRIDE * 4 + op->dst_x * bytespp,
+                buf + (op->src_y + row) * STRIDE * 4 + op->src_x * bytespp,
+                row_bytes);
+    }
+}
+
+/*
+ * Split the rectangle into a grid of boxes with some holes, ordered like
+ * miCopyRegion does for the overlapping copies (bottom to top if moving
+ * down, right to left if moving right).
+ */
+static void split_boxes(blt_op_t *op)
+{
+    int ncols = 1 + rand_range(op->w < 4 ? op->w : 4);
+    int nrows = 1 + rand_range(op->h < 4 ? op->h : 4);
+    int row, col;
+
+    op->nboxes = 0;
+    for (row = 0; row < nrows; row++) {
+        int r = op->dst_y > op->src_y ? nrows - 1 - row : row;
+        for (col = 0; col < ncols; col++) {
+            int c = op->dst_x > op->src_x ? ncols - 1 - col : col;
+            blt2d_box_t *b = &op->boxes[op->nboxes];
+            /* keep at least one box */
+            if (rand_range(4) == 0 && (op->nboxes > 0 || row < nrows - 1 ||
+                                       col < ncols - 1))
+                continue;
+            b->x1 = op->dst_x + c * op->w / ncols;
+            b->x2 = op->dst_x + (c + 1) * op->w / ncols;
+            b->y1 = op->dst_y + r * op->h / nrows;
+            b->y2 = op->dst_y + (r + 1) * op->h / nrows;
+            op->nboxes++;
+        }
+    }
+}
+
+static void random_op(blt_op_t *op)
+{
+    op->kind = rand_range(OP_KINDS);
+    op->nboxes = 0;
+    if (op->kind == OP_CONVERT) {
+        /* The coordinates have to fit both 16bpp and 32bpp buffers */
+        random_rect(op, 32);
+        op->bpp = rand_range(2) ? 16 : 32;
+        op->dst_bpp = 48 - op->bpp;
+        op->to_cached = rand_range(2);
+        op->dither = rand_range(2);
+        if (rand_range(2))
+            split_boxes(op);
+    }
+    else {
+        random_rect(op, 0);
+        op->dst_bpp = op->bpp;
+        if (op->kind == OP_FILL)
+            op->filler = lcg_rand() ^ (lcg_rand() << 24);
+        if (op->kind == OP_BLT_BOXES)
+            split_boxes(op);
+    }
+}
+
+static void reference_fill(uint8_t *buf, const blt_op_t *op)
+{
+    int x, y;
+    for (y = op->dst_y; y < op->dst_y + op->h; y++) {
+        uint8_t *row = buf + y * STRIDE * 4;
+        for (x = op->dst_x; x < op->dst_x + op->w; x++) {
+            if (op->bpp == 8)
+                row[x] = op->filler;
+            else if (op->bpp == 16)
+                ((uint16_t *)row)[x] = op->filler;
+            else
+                ((uint32_t *)row)[x] = op->filler;
+        }
+    }
+}
+
+/* Convert the part of the rectangle, which is in the destination box */
+static void reference_convert(uint8_t *dst, const uint8_t *src,
+                              const blt_op_t *op, const blt2d_box_t *box)
+{
+    int x, y;
+    for (y = box->y1; y < box->y2; y++) {
+        int sy = y - op->dst_y + op->src_y;
+        for (x = box->x1; x < box->x2; x++) {
+            int sx = x - op->dst_x + op->src_x;
+            if (op->bpp == 16) {
+                ((uint32_t *)(dst + y * STRIDE * 4))[x] =
+                    reference_0565_to_8888(
+                        ((const uint16_t *)(src + sy * STRIDE * 4))[sx]);
+            }
+            else {
+                int d = op->dither ? dither_matrix_4x4[y & 3][x & 3] : 0;
+                ((uint16_t *)(dst + y * STRIDE * 4))[x] =
+                    reference_8888_to_0565(
+                        ((const uint32_t *)(src + sy * STRIDE * 4))[sx],
+                        d >> 1, d >> 2);
+            }
+        }
+    }
+}
+
+/*
+ * Do the operation on the reference buffers ('ref' is the framebuffer and
+ * 'cached' is the other side of the converting copies)
+ */
+static void reference_op(uint8_t *ref, uint8_t *cached, const blt_op_t *op)
+{
+    blt_op_t box_op = *op;
+    blt2d_box_t rect;
+    int i;
+
+    switch (op->kind) {
+    case OP_OVERLAPPED_BLT:
+        reference_blt(ref, op);
+        break;
+    case OP_BLT_BOXES:
+        for (i = 0; i < op->nboxes; i++) {
+            const blt2d_box_t *b = &op->boxes[i];
+            box_op.dst_x = b->x1;
+            box_op.dst_y = b->y1;
+            box_op.src_x = b->x1 - op->dst_x + op->src_x;
+            box_op.src_y = b->y1 - op->dst_y + op->src_y;
+            box_op.w = b->x2 - b->x1;
+            box_op.h = b->y2 - b->y1;
+            reference_blt(ref, &box_op);
+        }
+        break;
+    case OP_FILL:
+        reference_fill(ref, op);
+        break;
+    case OP_CONVERT:
+        rect.x1 = op->dst_x;
+        rect.y1 = op->dst_y;
+        rect.x2 = op->dst_x + op->w;
+        rect.y2 = op->dst_y + op->h;
+        if (op->nboxes == 0)
+            reference_convert(op->to_cached ? cached : ref,
+                              op->to_cached ? ref : cached, op, &rect);
+        for (i = 0; i < op->nboxes; i++)
+            reference_convert(op->to_cached ? cached : ref,
+                              op->to_cached ? ref : cached, op,
+                              &op->boxes[i]);
+        break;
+    }
+}
+
+/* Do the operation using 'blt2d', returns 0 if it has been rejected */
+static int run_op(blt2d_i *blt2d, uint8_t *buf, uint8_t *cached,
+                  const blt_op_t *op)
+{
+    uint32_t *src = (uint32_t *)buf, *dst = (uint32_t *)buf;
+
+    if (op->kind == OP_CONVERT) {
+        if (op->to_cached)
+            dst = (uint32_t *)cached;
+        else
+            src = (uint32_t *)cached;
+    }
+
+    if (op->kind == OP_FILL)
+        return blt2d->fill(blt2d->self, dst, STRIDE, op->bpp,
+                           op->dst_x, op->dst_y, op->w, op->h, op->filler);
+    if (op->nboxes > 0)
+        return blt2d->blt_boxes(blt2d->self, src, dst, STRIDE, STRIDE,
+                                op->bpp, op->dst_bpp, op->boxes, op->nboxes,
+                                op->src_x - op->dst_x, op->src_y - op->dst_y,
+                                0, 0) == op->nboxes;
+    return blt2d->overlapped_blt(blt2d->self, src, dst, STRIDE, STRIDE,
+                                 op->bpp, op->dst_bpp, op->src_x, op->src_y,
+                                 op->dst_x, op->dst_y, op->w, op->h);
+}
+
+/*
+ * Run 'nops' random operations through 'blt2d'. The converting copies are
+ * done between 'buf' and a buffer in the cached memory, the dithering is
+ * enabled randomly for them via 'dither_32_to_16' (if it is not NULL).
+ * Returns the number of the operations with mismatching results.
+ */
+static int fuzz_blt2d(blt2d_i *blt2d, int *dither_32_to_16,
+                      const char *name, const char *mode,
+                      uint8_t *buf, uint8_t *ref, int nops, uint32_t seed)
+{
+    size_t size = (size_t)STRIDE * HEIGHT * 4;
+    double t, total_time = 0, total_pixels = 0;
+    int i, failures = 0;
+    int old_dither = dither_32_to_16 ? *dither_32_to_16 : 0;
+    uint8_t *cached = malloc(size);
+    uint8_t *cached_ref = malloc(size);
+    blt_op_t op;
+
+    if (!cached || !cached_ref) {
+        printf("memory allocation failed\n");
+        free(cached);
+        free(cached_ref);
+        return 1;
+    }
+
+    rand_state = seed;
+    for (i = 0; i < (int)size; i++)
+        ref[i] = lcg_rand();
+    memcpy(buf, ref, size);
+    for (i = 0; i < (int)size; i++)
+        cached_ref[i] = lcg_rand();
+    memcpy(cached, cached_ref, size);
+
+    for (i = 0; i < nops; i++) {
+        random_op(&op);
+        if (!dither_32_to_16)
+            op.dither = 0;
+        else
+            *dither_32_to_16 = op.dither;
+        reference_op(ref, cached_ref, &op);
+
+        t = gettime();
+        if (!run_op(blt2d, buf, cached, &op)) {
+            printf("%s (%s): %s operation %d was rejected\n",
+                   name, mode, op_names[op.kind], i);
+            failures++;
+            memcpy(buf, ref, size);
+            memcpy(cached, cached_ref, size);
+            continue;
+        }
+        total_time += gettime() - t;
+        total_pixels += (double)op.w * op.h;
+
+        if (memcmp(buf, ref, size) != 0 ||
+            memcmp(cached, cached_ref, size) != 0) {
+            uint8_t *b = buf, *r = ref;
+            size_t offs = 0;
+            if (memcmp(buf, ref, size) == 0) {
+                b = cached;
+                r = cached_ref;
+            }
+            while (b[offs] == r[offs])
+                offs++;
+            if (failures < 10) {
+                printf("%s (%s): %s mismatch at byte %d (row %d%s) after "
+                       "operation %d: bpp=%d->%d src=(%d,%d) dst=(%d,%d) "
+                       "size=%dx%d boxes=%d dither=%d\n", name, mode,
+                       op_names[op.kind], (int)offs,
+                       (int)(offs / (STRIDE * 4)),
+                       b == cached ? " of the cached buffer" : "", i,
+                       op.bpp, op.dst_bpp, op.src_x, op.src_y,
+                       op.dst_x, op.dst_y, op.w, op.h, op.nboxes, op.dither);
+            }
+            failures++;
+            memcpy(buf, ref, size);
+            memcpy(cached, cached_ref, size);
+        }
+    }
+
+    if (dither_32_to_16)
+        *dither_32_to_16 = old_dither;
+    free(cached);
+    free(cached_ref);
+
+    printf("%-16s %-16s %8d ops, %5d failures, %8.2f MPix/s\n",
+           name, mode, nops, failures,
+           total_time > 0 ? total_pixels / total_time / 1000000. : 0.);
+    return failures;
+}
+
+/* Test the current kernel with and without the worker threads */
+static int fuzz_cpu_backend(cpu_backend_t *cpu_backend, const char *name,
+                            uint8_t *buf, uint8_t *ref,
+                            int nops, uint32_t seed)
+{
+    int failures;
+
+    cpu_backend->parallel_blt_threshold = INT_MAX;
+    failures = fuzz_blt2d(&cpu_backend->blt2d, &cpu_backend->dither_32_to_16,
+                          name, "single thread", buf, ref, nops, seed);
+
+    if (cpu_backend->worker_pool) {
+        /* Split everything, which is large enough to make bands */
+        cpu_backend->parallel_blt_threshold = 0;
+        failures += fuzz_blt2d(&cpu_backend->blt2d,
+                               &cpu_backend->dither_32_to_16, name,
+                               "multi-threaded", buf, ref, nops, seed);
+    }
+    return failures;
+}
+
+/*
+ * Check cpu_backend_rotated_blt with random rectangles of random source
+ * images, rotated into 'buf'. The reference result is built in 'ref' one
+ * pixel at a time, so the pixels outside of the destination rectangle must
+ * stay intact too.
+ */
+static int fuzz_rotated_blt(cpu_backend_t *cpu_backend, const char *name,
+                            uint8_t *buf, uint8_t *ref, int nops,
+                            uint32_t seed)
+{
+    static const int bpps[] = { 8, 16, 32 };
+    static const int rotations[] = { 90, 180, 270 };
+    size_t size = (size_t)STRIDE * HEIGHT * 4;
+    int i, j, failures = 0;
+
+    rand_state = seed;
+    for (i = 0; i < (int)size; i++)
+        ref[i] = lcg_rand();
+    memcpy(buf, ref, size);
+
+    for (i = 0; i < nops; i++) {
+        int bpp = bpps[rand_range(3)];
+        int rotation = rotations[rand_range(3)];
+        int bytespp = bpp / 8;
+        int max_w = rotation == 180 ? STRIDE * 32 / bpp : HEIGHT;
+        int max_h = rotation == 180 ? HEIGHT : STRIDE * 32 / bpp;
+        int src_width, src_height, src_stride, x, y, w, h, px, py;
+        uint8_t *src;
+
+        /* Mostly small images, but sometimes as large as the buffer */
+        src_width = 1 + rand_range(rand_range(4) ? 40 : max_w);
+        src_height = 1 + rand_range(rand_range(4) ? 40 : max_h);
+        if (src_width > max_w)
+            src_width = max_w;
+        if (src_height > max_h)
+            src_height = max_h;
+        src_stride = (src_width * bytespp + 3) / 4 + rand_range(4);
+        src = malloc((size_t)src_stride * 4 * src_height);
+        if (!src) {
+            printf("memory allocation failed\n");
+            return failures + 1;
+        }
+        for (j = 0; j < src_stride * 4 * src_height; j++)
+            src[j] = lcg_rand();
+
+        w = 1 + rand_range(src_width);
+        h = 1 + rand_range(src_height);
+        x = rand_range(src_width - w + 1);
+        y = rand_range(src_height - h + 1);
+
+        for (py = y; py < y + h; py++) {
+            for (px = x; px < x + w; px++) {
+                int dx, dy;
+                if (rotation == 90) {
+                    dx = py;
+                    dy = src_width - 1 - px;
+                }
+                else if (rotation == 180) {
+                    dx = src_width - 1 - px;
+                    dy = src_height - 1 - py;
+                }
+                else {
+                    dx = src_height - 1 - py;
+                    dy = px;
+                }
+                memcpy(ref + dy * STRIDE * 4 + dx * bytespp,
+                       src + py * src_stride * 4 + px * bytespp, bytespp);
+            }
+        }
+
+        if (!cpu_backend_rotated_blt(cpu_backend, (uint32_t *)src,
+                                     (uint32_t *)buf, src_stride, STRIDE,
+                                     bpp, rotation, src_width, src_height,
+                                     x, y, w, h)) {
+            printf("%s (rotated_blt): operation %d was rejected\n", name, i);
+            failures++;
+            memcpy(buf, ref, size);
+        }
+        else if (memcmp(buf, ref, size) != 0) {
+            size_t offs = 0;
+            while (buf[offs] == ref[offs])
+                offs++;
+            if (failures < 10) {
+                printf("%s (rotated_blt): mismatch at byte %d (row %d) "
+                       "after operation %d: bpp=%d rotation=%d "
+                       "image=%dx%d rect=(%d,%d) size=%dx%d\n",
+                       name, (int)offs, (int)(offs / (STRIDE * 4)), i, bpp,
+                       rotation, src_width, src_height, x, y, w, h);
+            }
+            failures++;
+            memcpy(buf, ref, size);
+        }
+        free(src);
+    }
+
+    printf("%-16s %-16s %8d ops, %5d failures\n",
+           name, "rotated_blt", nops, failures);
+    return failures;
+}
+
+typedef void (*convert_8888_to_0565_t)(uint16_t *dst, const uint32_t *src,
+                                       int width, const uint8_t *dither);
+
+/*
+ * Check the 32bpp to 16bpp conversion done by cpu_backend_shadow_update
+ * with random boxes (any widths and x offsets, with and without dithering,
+ * with and without the worker threads) against a per-pixel reference. If
+ * 'convert_c' is not NULL, the installed convert_8888_to_0565 kernel is
+ * also compared with it directly, using random dither values.
+ */
+static int fuzz_shadow_0565(cpu_backend_t *cpu_backend, const char *name,
+                            convert_8888_to_0565_t convert_c,
+                            uint8_t *buf, uint8_t *ref, int nops,
+                            uint32_t seed)
+{
+    size_t size = (size_t)STRIDE * HEIGHT * 4;
+    int width = STRIDE * 2;
+    uint32_t *shadow = malloc((size_t)width * HEIGHT * 4);
+    uint32_t pixels[512];
+    uint16_t out[512], out_c[512];
+    uint8_t dither[16];
+    int i, j, x, y, failures = 0;
+
+    if (!shadow) {
+        printf("memory allocation failed\n");
+        return 1;
+    }
+
+    rand_state = seed;
+    for (i = 0; i < (int)size; i++)
+        ref[i] = lcg_rand();
+    memcpy(buf, ref, size);
+    for (i = 0; i < width * HEIGHT; i++)
+        shadow[i] = lcg_rand() ^ (lcg_rand() << 24);
+
+    for (i = 0; i < nops; i++) {
+        blt2d_box_t box;
+        int w = rand_range(2) ? 1 + rand_range(40) : 1 + rand_range(width);
+        int h = rand_range(2) ? 1 + rand_range(8) : 1 + rand_range(HEIGHT);
+        int dithered = rand_range(2);
+
+        box.x1 = rand_range(width - w + 1);
+        box.y1 = rand_range(HEIGHT - h + 1);
+        box.x2 = box.x1 + w;
+        box.y2 = box.y1 + h;
+
+        for (y = box.y1; y < box.y2; y++) {
+            uint16_t *d = (uint16_t *)(ref + y * STRIDE * 4);
+            for (x = box.x1; x < box.x2; x++) {
+                int dd = dithered ? dither_matrix_4x4[y & 3][x & 3] : 0;
+                d[x] = reference_8888_to_0565(shadow[y * width + x],
+                                              dd >> 1, dd >> 2);
+            }
+        }
+
+        cpu_backend->dither_32_to_16 = dithered;
+        cpu_backend->parallel_blt_threshold = rand_range(2) ? 0 : INT_MAX;
+        if (!cpu_backend_shadow_update(cpu_backend, shadow, (uint32_t *)buf,
+                                       width, STRIDE, 32, 16, &box, 1)) {
+            printf("%s (shadow 32->16): operation %d was rejected\n",
+                   name, i);
+            failures++;
+            memcpy(buf, ref, size);
+        }
+        else if (memcmp(buf, ref, size) != 0) {
+            size_t offs = 0;
+            while (buf[offs] == ref[offs])
+                offs++;
+            if (failures < 10) {
+                printf("%s (shadow 32->16): mismatch at byte %d (row %d) "
+                       "after operation %d: dither=%d box=(%d,%d)-(%d,%d)\n",
+                       name, (int)offs, (int)(offs / (STRIDE * 4)), i,
+                       dithered, box.x1, box.y1, box.x2, box.y2);
+            }
+            failures++;
+            memcpy(buf, ref, size);
+        }
+
+        if (!convert_c)
+            continue;
+
+        /* The SIMD kernels only handle the multiples of 8 pixels */
+        w = 8 * (1 + rand_range(512 / 8));
+        for (j = 0; j < w; j++)
+            pixels[j] = lcg_rand() ^ (lcg_rand() << 24);
+        for (j = 0; j < 8; j++) {
+            dither[j] = rand_range(8);
+            dither[8 + j] = rand_range(4);
+        }
+        if (rand_range(2))
+            memset(dither, 0, sizeof(dither));
+        cpu_backend->convert_8888_to_0565(out, pixels, w, dither);
+        convert_c(out_c, pixels, w, dither);
+        if (memcmp(out, out_c, w * 2) != 0) {
+            if (failures < 10) {
+                printf("%s (convert_8888_to_0565): mismatch after "
+                       "operation %d: width=%d\n", name, i, w);
+            }
+            failures++;
+        }
+    }
+
+    free(shadow);
+    printf("%-16s %-16s %8d ops, %5d failures\n",
+           name, "shadow 32->16", nops, failures);
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = (size_t)STRIDE * HEIGHT * 4;
+    long page_size = sysconf(_SC_PAGESIZE);
+    uint32_t seed = 1;
+    int nops = 20000;
+    int opt, i, res, failures = 0;
+    cpu_backend_t *cpu_backend;
+    convert_8888_to_0565_t convert_c;
+    uint8_t *mapping, *buf, *ref;
+
+    while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            nops = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            printf("Usage: %s [-n operations] [-s seed]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    /* The test buffer with a guard page before and after it */
+    mapping = mmap(NULL, size + 2 * page_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ref = malloc(size);
+    if (mapping == MAP_FAILED || !ref) {
+        printf("memory allocation failed\n");
+        return 1;
+    }
+    buf = mapping + page_size;
+    mprotect(mapping, page_size, PROT_NONE);
+    mprotect(buf + size, page_size, PROT_NONE);
+
+    cpu_backend = cpu_backend_init(buf, size);
+    if (!cpu_backend) {
+        printf("cpu_backend_init failed\n");
+        return 1;
+    }
+
+    /* Always test the multi-threaded code, even on a single core system */
+    if (!cpu_backend->worker_pool)
+        cpu_backend->worker_pool = worker_pool_init(CPU_BACKEND_MAX_THREADS);
+
+    printf("seed %u\n", seed);
+
+    /* The default implementation picked by the heuristics */
+    failures += fuzz_cpu_backend(cpu_backend, "default", buf, ref, nops, seed);
+
+    /* And then each kernel supported by this CPU */
+    for (i = 0; (res = cpu_backend_select_kernel(cpu_backend, i)) >= 0; i++) {
+        if (res > 0)
+            failures += fuzz_cpu_backend(cpu_backend, cpu_backend->blt2d_name,
+                                         buf, ref, nops, seed);
+    }
+
+    /*
+     * The C transpose and conversion kernels, and the SIMD ones if this
+     * CPU has any (the conversion is also compared with the C kernel)
+     */
+    cpu_backend_select_simd(cpu_backend, 0);
+    convert_c = cpu_backend->convert_8888_to_0565;
+    failures += fuzz_rotated_blt(cpu_backend, "generic C", buf, ref,
+                                 nops, seed);
+    failures += fuzz_shadow_0565(cpu_backend, "generic C", NULL, buf, ref,
+                                 nops, seed);
+    if (cpu_backend_select_simd(cpu_backend, 1)) {
+        failures += fuzz_rotated_blt(cpu_backend, "SIMD", buf, ref,
+                                     nops, seed);
+        failures += fuzz_shadow_0565(cpu_backend, "SIMD", convert_c,
+                                     buf, ref, nops, seed);
+    }
+
+    cpu_backend_close(cpu_backend);
+    munmap(mapping, size + 2 * page_size);
+    free(ref);
+
+    if (failures) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}